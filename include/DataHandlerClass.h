@@ -42,20 +42,134 @@
 
 
 #include "mmWave.h"
+#include "SPSCQueue.h"
+#include "mmWaveFrame.h"
+#include "mmWavePacket.h"
+#include "mmWaveDecode.h"
+#include "mmWaveAngleFft.h"
 #include <iostream>
 #include <cstdio>
 #include <cstdlib>
+#include <string>
+#include <atomic>
 #include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
+#include <semaphore.h>
+#include <pthread.h>
 #include "ros/ros.h"
 #include "sensor_msgs/PointCloud2.h"
-#define COUNT_SYNC_MAX 2
+#include "ti_mmwave_rospkg/RangeProfile.h"
+#include "ti_mmwave_rospkg/LatencyBudget.h"
+#include "sensor_msgs/Image.h"
+#define FRAME_QUEUE_SIZE 8  //packets the read thread can be ahead of the sort threads
+#define FRAME_POOL_SIZE (FRAME_QUEUE_SIZE + 1 + MAX_SORT_THREADS)  //queued packets plus the one being read and one per sort thread
+#define MAX_SORT_THREADS 8  //largest number of sort threads (setSortThreads)
+#define UNDECIDED_TIMEOUT_NS 5000000  //how long a packet ending in what may start the next one waits for the bytes that tell (ns), checked after every read or read timeout
 
-class DataUARTHandler{
+struct RadarPoint;
+namespace pcl { template <typename PointT> class PointCloud; }
+
+class DataUARTHandler;
+
+/*State of one sort thread. Every sort thread decodes whole packets on its own, the read thread hands them out round-robin*/
+struct mmwSortContext
+{
+    mmwSortContext() : frameQueue(FRAME_POOL_SIZE), currentFramep(NULL) {}
+    
+    /*Handler the thread belongs to*/
+    DataUARTHandler *handler;
+    
+    pthread_t thread;
+    
+    /*Complete packets queued by the read thread for this sort thread (room for the whole pool so a push never fails)*/
+    SPSCQueue<mmwFrame*> frameQueue;
+    
+    /*Counts packets in frameQueue, lets the sort thread sleep while the queue is empty*/
+    sem_t frameQueue_sem;
+    
+    /*Pointer to current packet (sort), owned by the sort thread*/
+    mmwFrame* currentFramep;
+    
+    /*Sorted mmwDemo Data structure*/
+    mmwDataPacket mmwData;
+    
+    /*Parser the sort thread calls for every packet, selectPacketLayout until a valid header has been seen*/
+    void (DataUARTHandler::*sortPacket)(mmwSortContext &ctx, const FrameView &frame);
+    
+    /*version and platform the current parser was chosen for*/
+    uint32_t layoutVersion;
+    
+    uint32_t layoutPlatform;
+    
+    /*Detected points, side info and noise profile TLVs of the packet being sorted, empty if it has none*/
+    FrameView pointCloudTlv;
+    
+    FrameView sideInfoTlv;
+    
+    FrameView noiseProfileTlv;
+    
+    /*Unit tables the packet being sorted is decoded with*/
+    boost::shared_ptr<const mmwUnitTables> sortTables;
+    
+    /*Detected points of the packet being sorted in physical units, before the FOV filter*/
+    mmwDetectedPoints points;
+    
+    /*Indices of the detected points that pass the point filter*/
+    std::vector<uint32_t> selectedPoints;
+    
+    /*Point cloud of the packet being sorted, RScanReady once it is complete and waits to be published*/
+    boost::shared_ptr<pcl::PointCloud<RadarPoint> > RScan;
+    
+    bool RScanReady;
+    
+    /*Range profile of the packet being sorted, rangeProfileReady once it waits to be published*/
+    ti_mmwave_rospkg::RangeProfilePtr rangeProfile;
+    
+    bool rangeProfileReady;
     
+    /*Range/doppler heatmap of the packet being sorted in dB and its 8 bit normalized variant, ready once they wait to be published*/
+    sensor_msgs::ImagePtr rangeDopplerImage;
+    
+    bool rangeDopplerImageReady;
+    
+    sensor_msgs::ImagePtr rangeDopplerMono;
+    
+    bool rangeDopplerMonoReady;
+    
+    /*Angle FFT set up for the azimuth antennas of the device*/
+    mmwAngleFft angleFft;
+    
+    /*Range/azimuth map of the packet being sorted, azimuthImageReady once it waits to be published*/
+    sensor_msgs::ImagePtr azimuthImage;
+    
+    bool azimuthImageReady;
+    
+    /*Latency budget of the packet being sorted, only filled while latency_budget has subscribers (latencyWanted).
+      latencyReady once the packet header is valid, statsSeen once the device times are in*/
+    ti_mmwave_rospkg::LatencyBudgetPtr latency;
+    
+    bool latencyWanted;
+    
+    bool latencyReady;
+    
+    bool statsSeen;
+    
+    /*CLOCK_MONOTONIC time in ns when decoding the packet started and ended*/
+    uint64_t parseStartNs;
+    
+    uint64_t parseEndNs;
+};
+
+/*Decodes one TLV of the packet ctx is sorting, tlv is a view of its payload (checked to lie inside the packet, the handler
+  checks its contents fit in tlv). Handlers run on several sort threads at once if setSortThreads() > 1, so they keep
+  their state in ctx*/
+typedef boost::function<void (mmwSortContext &ctx, const FrameView &tlv)> TlvHandler;
+
+class DataUARTHandler{
+
 public:
     
     /*Constructor*/
-   //void DataUARTHandler(ros::NodeHandle* nh) : currentBufp(&pingPongBuffers[0]) , nextBufp(&pingPongBuffers[1]) {}
     DataUARTHandler(ros::NodeHandle* nh);
     
     /*User callable function to set the UARTPort*/
@@ -63,15 +177,50 @@ public:
     
     /*User callable function to set the BaudRate*/
     void setBaudRate(int myBaudRate);
-
+    
+    /*User callable function to set where the data stream is read from ("serial", "termios", "file", "tcp", "udp" or "pty")*/
+    void setDataSource(const std::string &myDataSource);
+    
     /*User callable function to set maxAllowedElevationAngleDeg*/
     void setMaxAllowedElevationAngleDeg(int myMaxAllowedElevationAngleDeg);
     
     /*User callable function to set maxAllowedElevationAngleDeg*/
     void setMaxAllowedAzimuthAngleDeg(int myMaxAllowedAzimuthAngleDeg);
-
+    
+    /*User callable function to keep only points with minRange <= range <= maxRange (meters)*/
+    void setRangeLimits(float minRange, float maxRange);
+    
+    /*User callable function to keep only points with minDoppler <= doppler <= maxDoppler (m/s)*/
+    void setDopplerLimits(float minDoppler, float maxDoppler);
+    
+    /*User callable function to keep only points with minIntensity <= intensity <= maxIntensity (dB)*/
+    void setIntensityLimits(float minIntensity, float maxIntensity);
+    
+    /*User callable function to set the max number of bytes taken from the data port per read call*/
+    void setReadBlockSize(int myReadBlockSize);
+    
+    /*User callable function to set the number of angle bins of the range/azimuth map (a power of 2)*/
+    void setAzimuthFftSize(int myAzimuthFftSize);
+    
+    /*User callable function to set the number of threads computing the range bins of one range/azimuth map*/
+    void setAzimuthFftThreads(int myAzimuthFftThreads);
+    
     void setNodeHandle(ros::NodeHandle* nh);
-      
+    
+    /*User callable function to set the number of threads packets are sorted on, results are still published in packet order*/
+    void setSortThreads(int mySortThreads);
+    
+    /*User callable function to decode TLVs of type tlvType with handler (replaces any previous handler), must be called before start()*/
+    void registerTlvHandler(uint32_t tlvType, const TlvHandler &handler);
+    
+    /*Same as above for a TLV that is only decoded to be published on output: TLVs of type tlvType are skipped while
+      output has no subscribers and decoded again as soon as one connects*/
+    void registerTlvHandler(uint32_t tlvType, const TlvHandler &handler, const ros::Publisher &output);
+    
+    /*User callable function to also decode TLVs of type tlvType while output has subscribers, for handlers publishing on
+      more than one topic. Must be called after registerTlvHandler() and before start()*/
+    void addTlvOutput(uint32_t tlvType, const ros::Publisher &output);
+    
     /*User callable function to start the handler's internal threads*/
     void start(void);
     
@@ -79,20 +228,18 @@ public:
     static void* readIncomingData_helper(void *context);
     
     static void* sortIncomingData_helper(void *context);
-    
-    static void* syncedBufferSwap_helper(void *context);
-    
-    /*Sorted mmwDemo Data structure*/
-    mmwDataPacket mmwData;
 
 private:
     
-    /*Contains the name of the serial port*/
+    /*Contains the name of the serial port (or file, "host:port" address or pty link depending on dataSource)*/
     char* dataSerialPort;
     
     /*Contains the baud Rate*/
     int dataBaudRate;
     
+    /*Contains the data source type, see createByteSource()*/
+    std::string dataSource;
+    
     /*Contains the max_allowed_elevation_angle_deg (points with elevation angles 
       outside +/- max_allowed_elevation_angle_deg will be removed)*/
     int maxAllowedElevationAngleDeg;
@@ -101,60 +248,142 @@ private:
       outside +/- max_allowed_azimuth_angle_deg will be removed)*/
     int maxAllowedAzimuthAngleDeg;
     
-    /*Mutex protected variable which synchronizes threads*/
-    int countSync;
+    /*Contains the max number of bytes taken from the data port per read call*/
+    int readBlockSize;
+    
+    /*Angle bins of the range/azimuth map and threads computing it*/
+    uint32_t azimuthFftSize;
+    
+    int azimuthFftThreads;
+    
+    /*Largest totalPacketLen the active config can produce, packets claiming more are treated as corrupt. Updated by
+      checkChirpConfig, picked up by the read thread*/
+    std::atomic<uint32_t> maxPacketLen;
     
-    /*Read/Write Buffers*/
-    std::vector<uint8_t> pingPongBuffers[2];
+    /*Packet buffers, allocated once in start() and recycled between the read and sort threads*/
+    std::vector<mmwFrame> framePool;
     
-    /*Pointer to current data (sort)*/
-    std::vector<uint8_t>* currentBufp;
+    /*Empty packet buffers handed back by the sort threads to the read thread*/
+    SPSCQueue<mmwFrame*> freeQueue;
     
-    /*Pointer to new data (read)*/
-    std::vector<uint8_t>* nextBufp;
+    /*Serializes the sort threads' pushes to freeQueue (it has a single producer side)*/
+    pthread_mutex_t freeQueue_mutex;
     
-    /*Mutex protecting the countSync variable */
-    pthread_mutex_t countSync_mutex;
+    /*Number of times a packet buffer had to grow past its preallocated size (stays 0 until the chirp configuration grows).
+      Only counts these, the framing and point decoding are checked not to allocate by the DataPath gtest*/
+    unsigned long packetBufferGrowths;
     
-    /*Mutex protecting the nextBufp pointer*/
-    pthread_mutex_t nextBufp_mutex;
+    /*Number of sort threads*/
+    int sortThreads;
     
-    /*Mutex protecting the currentBufp pointer*/
-    pthread_mutex_t currentBufp_mutex;
+    /*One context per sort thread, created in start()*/
+    std::vector<boost::shared_ptr<mmwSortContext> > sortWorkers;
     
-    /*Condition variable which blocks the Swap Thread until signaled*/
-    pthread_cond_t countSync_max_cv;
+    /*Sequence number the read thread gives the next complete packet, packet n goes to sortWorkers[n % sortThreads]*/
+    uint64_t nextPacketSeq;
     
-    /*Condition variable which blocks the Read Thread until signaled*/
-    pthread_cond_t read_go_cv;
+    /*Sequence number of the next packet to publish the results of (guarded by publish_mutex)*/
+    uint64_t nextPublishSeq;
     
-    /*Condition variable which blocks the Sort Thread until signaled*/
-    pthread_cond_t sort_go_cv;
+    pthread_mutex_t publish_mutex;
     
-    /*Swap Buffer Pointers Thread*/
-    void *syncedBufferSwap(void);
+    pthread_cond_t publish_cond;
     
-    /*Checks if the magic word was found*/
-    int isMagicWord(uint8_t last8Bytes[8]);
+    /*Blocks until the next packet is queued for ctx and moves it to ctx.currentFramep, returns false on shutdown*/
+    bool waitForPacket(mmwSortContext &ctx);
+    
+    /*Waits until every earlier packet has been published, then publishes the results of ctx's packet*/
+    void publishInOrder(mmwSortContext &ctx);
     
     /*Read incoming UART Data Thread*/
     void *readIncomingData(void);
     
     /*Sort incoming UART Data Thread*/
-    void *sortIncomingData(void);
+    void *sortIncomingData(mmwSortContext &ctx);
+    
+    /*Chooses the parser for the device and SDK in the packet's header and sorts the packet with it*/
+    void selectPacketLayout(mmwSortContext &ctx, const FrameView &frame);
+    
+    /*Parser specialized on a packet layout, decodes the header into ctx.mmwData.header and hands the TLVs to sortTlvs*/
+    template <int Layout>
+    void sortPacketAs(mmwSortContext &ctx, const FrameView &frame);
+    
+    /*Hands the TLVs starting at offset currentDatap to their handlers*/
+    void sortTlvs(mmwSortContext &ctx, const FrameView &frame, uint32_t currentDatap);
+    
+    /*TLV handler for MMWDEMO_OUTPUT_MSG_DETECTED_POINTS, keeps the TLV for sortDetectedObjs (SDK 1.x) or sortPointCloud (SDK 2.x and newer)*/
+    void sortDetectedPoints(mmwSortContext &ctx, const FrameView &tlv);
+    
+    /*TLV handler for MMWDEMO_OUTPUT_MSG_DETECTED_POINTS_SIDE_INFO, keeps the TLV for sortPointCloud*/
+    void sortSideInfo(mmwSortContext &ctx, const FrameView &tlv);
+    
+    /*TLV handler for MMWDEMO_OUTPUT_MSG_NOISE_PROFILE, keeps the TLV for sortDetectedObjs and sortRangeNoise*/
+    void sortNoiseProfile(mmwSortContext &ctx, const FrameView &tlv);
+    
+    /*Decodes the SDK 1.x detected objects into the point cloud, with their SNR if the packet has a noise profile*/
+    void sortDetectedObjs(mmwSortContext &ctx);
+    
+    /*Decodes the SDK 2.x and newer points together with their side info into the point cloud*/
+    void sortPointCloud(mmwSortContext &ctx);
+    
+    /*Stamps ctx.RScan for the packet being sorted and marks it ready to publish*/
+    void finishRScan(mmwSortContext &ctx);
+    
+    /*TLV handler for MMWDEMO_OUTPUT_MSG_RANGE_PROFILE, decodes it into ctx.rangeProfile (only while range_profile has subscribers)*/
+    void sortRangeProfile(mmwSortContext &ctx, const FrameView &tlv);
+    
+    /*Adds the noise profile of the packet being sorted to ctx.rangeProfile*/
+    void sortRangeNoise(mmwSortContext &ctx);
+    
+    /*TLV handler for MMWDEMO_OUTPUT_MSG_RANGE_DOPPLER_HEAT_MAP, decodes it into ctx.rangeDopplerImage and, while it has
+      subscribers, ctx.rangeDopplerMono*/
+    void sortRangeDopplerHeatmap(mmwSortContext &ctx, const FrameView &tlv);
+    
+    /*TLV handler for MMWDEMO_OUTPUT_MSG_AZIMUTH_STATIC_HEAT_MAP, runs the angle FFT over it into ctx.azimuthImage*/
+    void sortAzimuthHeatmap(mmwSortContext &ctx, const FrameView &tlv);
+    
+    /*TLV handler for MMWDEMO_OUTPUT_MSG_STATS, decodes the device times into ctx.latency*/
+    void sortStats(mmwSortContext &ctx, const FrameView &tlv);
+    
+    /*Fills the host times of ctx.latency, publishTimeNs is when the packet's results were published*/
+    void finishLatency(mmwSortContext &ctx, uint64_t publishTimeNs);
+    
+    /*TLV handlers indexed by TLV type, empty entries are skipped*/
+    std::vector<TlvHandler> tlvHandlers;
+    
+    /*Publishers each TLV type is decoded for, indexed by TLV type. Types without publishers are decoded for every packet*/
+    std::vector<std::vector<ros::Publisher> > tlvOutputs;
+    
+    /*Returns true if TLVs of type tlvType (which has a handler) are to be decoded: no outputs, or one has subscribers*/
+    bool tlvWanted(uint32_t tlvType);
+    
+    /*Reads the chirp configuration params and derives the units from them, returns false if they are not set yet*/
+    bool readChirpConfig(mmwChirpConfig &config);
+    
+    /*Timer callback rebuilding unitTables when the chirp configuration params change*/
+    void checkChirpConfig(const ros::TimerEvent &event);
+    
+    /*Unit tables for the current chirp configuration, replaced as a whole on reconfiguration (guarded by unitTables_mutex)*/
+    boost::shared_ptr<const mmwUnitTables> unitTables;
+    
+    pthread_mutex_t unitTables_mutex;
+    
+    /*Field of view and gates applied to the detected points, set through the user callable setters*/
+    mmwPointFilter pointFilter;
     
     ros::NodeHandle* nodeHandle;
     
     ros::Publisher DataUARTHandler_pub;
     
-    /*Number of doppler bins*/
-    int numDopplerBins;
-    /*Number of range bins*/
-    int numRangeBins;
-    /*To convert rangeIdx to meters*/
-    float rangeIdxToMeters;
-    /*To convert dopplerIdx to m/s*/
-    float dopplerResolutionToMps;
+    ros::Publisher rangeProfile_pub;
+    
+    ros::Publisher rangeDopplerImage_pub;
+    
+    ros::Publisher rangeDopplerMono_pub;
+    
+    ros::Publisher azimuthImage_pub;
+    
+    ros::Publisher latency_pub;
 };
 
 #endif 
@@ -13,6 +13,8 @@ struct RadarPoint
   float intensity;
   float range;
   float doppler;
+  float snr;                        // dB, 0 if the sensor does not report it
+  float noise;                      // dB, 0 if the sensor does not report it
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW   // make sure our new allocators are aligned
 } EIGEN_ALIGN16;                    // enforce SSE padding for correct memory alignment
 
@@ -23,6 +25,8 @@ POINT_CLOUD_REGISTER_POINT_STRUCT (RadarPoint,           // here we assume a XYZ
                                    (float, intensity, intensity)
                                    (float, range, range)
                                    (float, doppler, doppler)
+                                   (float, snr, snr)
+                                   (float, noise, noise)
 )
 
 
@@ -0,0 +1,87 @@
+/*
+ * SPSCQueue.h
+ *
+ * This file defines a bounded lock-free single-producer/single-consumer queue
+ * used to hand packets from the DataUARTHandler read thread to the sort thread.
+ *
+ * push() is only ever called from one thread and pop() from one other thread.
+ * Neither call blocks: push() fails when the queue is full and pop() fails when
+ * it is empty.
+ *
+*/
+
+#ifndef _SPSC_QUEUE_
+#define _SPSC_QUEUE_
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+template <typename T>
+class SPSCQueue{
+    
+public:
+    
+    /*Constructor, the queue holds up to capacity items*/
+    explicit SPSCQueue(size_t capacity) : slots(capacity + 1), head(0), tail(0) {}
+    
+    /*Producer side, returns false if the queue is full*/
+    bool push(const T &item)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t next = increment(t);
+        
+        if(next == head.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        
+        slots[t] = item;
+        tail.store(next, std::memory_order_release);
+        
+        return true;
+    }
+    
+    /*Consumer side, returns false if the queue is empty*/
+    bool pop(T &item)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        
+        if(h == tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        
+        item = slots[h];
+        head.store(increment(h), std::memory_order_release);
+        
+        return true;
+    }
+    
+    /*Max number of items the queue can hold*/
+    size_t capacity(void) const
+    {
+        return slots.size() - 1;
+    }
+    
+private:
+    
+    size_t increment(size_t i) const
+    {
+        return (i + 1 == slots.size()) ? 0 : i + 1;
+    }
+    
+    /*One slot is always left empty to tell a full queue from an empty one*/
+    std::vector<T> slots;
+    
+    /*Index of the next item to pop, written by the consumer only*/
+    std::atomic<size_t> head;
+    
+    /*Padding so that head and tail do not share a cache line*/
+    char pad[64];
+    
+    /*Index of the next free slot, written by the producer only*/
+    std::atomic<size_t> tail;
+};
+
+#endif
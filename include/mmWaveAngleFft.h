@@ -0,0 +1,84 @@
+/*
+ * mmWaveAngleFft.h
+ *
+ * Host-side angle FFT turning the static azimuth heatmap TLV (the complex
+ * samples of every azimuth virtual antenna, per range bin) into a
+ * range-azimuth intensity map. Windowed, zero-padded radix-2 FFT without
+ * external dependencies, independent of the DataUARTHandler threads so it
+ * can be used on any captured packet.
+ *
+*/
+
+#ifndef _MMWAVE_ANGLE_FFT_
+#define _MMWAVE_ANGLE_FFT_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <pthread.h>
+#include <semaphore.h>
+
+struct mmwAngleFftWorker;
+
+class mmwAngleFft{
+
+public:
+    
+    mmwAngleFft();
+    
+    /*Stops the worker threads*/
+    ~mmwAngleFft();
+    
+    /*Sets up for numAntennas virtual antennas zero-padded to fftSize points, fftSize must be a power of 2 not smaller
+      than numAntennas. Returns false (and keeps the previous setup) otherwise*/
+    bool configure(uint32_t numAntennas, uint32_t fftSize);
+    
+    uint32_t getNumAntennas(void) const;
+    
+    uint32_t getFftSize(void) const;
+    
+    /*Computes the map of numRangeBins range bins of the TLV payload src (numAntennas cmplx16ImRe_t per range bin) into
+      out, numRangeBins rows of fftSize columns holding 10*log10(|X|^2 + 1). Columns are fftshifted, column k looks
+      towards sin(azimuth) = 2 * (k - fftSize/2) / fftSize for half-wavelength antenna spacing.
+      Range bins are split over numThreads threads, the calling thread and numThreads - 1 worker threads that are
+      started on first use and kept until the mmwAngleFft is destroyed. Not to be called from two threads at once*/
+    void compute(const uint8_t *src, uint32_t numRangeBins, float *out, int numThreads = 1);
+
+private:
+    
+    /*Owns threads, not copyable*/
+    mmwAngleFft(const mmwAngleFft &);
+    
+    mmwAngleFft &operator=(const mmwAngleFft &);
+    
+    /*Computes range bins [begin, end) of the job handed to worker, in its scratch buffers*/
+    void computeRows(mmwAngleFftWorker &worker) const;
+    
+    /*Starts one more worker thread, returns false if it cannot be created*/
+    bool startWorker(void);
+    
+    static void *worker_helper(void *context);
+    
+    /*workers[0] holds the job and scratch buffers of the calling thread, the others run a thread each*/
+    std::vector<mmwAngleFftWorker*> workers;
+    
+    /*Posted by a worker thread when its job is done*/
+    sem_t done_sem;
+    
+    uint32_t numAntennas;
+    
+    uint32_t fftSize;
+    
+    /*Hann window over the antennas*/
+    std::vector<float> window;
+    
+    /*exp(-2*pi*i*k/fftSize) for k < fftSize/2*/
+    std::vector<float> twiddleRe;
+    
+    std::vector<float> twiddleIm;
+    
+    /*Position of antenna n in the bit-reversed input of the FFT*/
+    std::vector<uint32_t> bitReverse;
+};
+
+#endif
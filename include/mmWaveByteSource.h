@@ -0,0 +1,223 @@
+/*
+ * mmWaveByteSource.h
+ *
+ * This file defines the byte sources the DataUARTHandler read thread can
+ * take the mmwDemo data stream from.
+ *
+ *  1) SerialByteSource  - the data UART through the serial library
+ *  2) TermiosByteSource - the data UART through raw termios and epoll, with
+ *                         low-latency tuning of the port
+ *  3) FileByteSource    - a captured data stream replayed from a file
+ *  4) TcpByteSource     - a network-bridged sensor, as a TCP client
+ *  5) UdpByteSource     - a network-bridged sensor sending UDP datagrams
+ *  6) PtyByteSource     - a pseudo-terminal other processes can write into
+ *
+ * createByteSource() builds one of them from the data_source and data_port
+ * parameters.
+ *
+*/
+
+#ifndef _MMWAVE_BYTE_SOURCE_
+#define _MMWAVE_BYTE_SOURCE_
+
+#include <cstdint>
+#include <string>
+#include "serial/serial.h"
+
+class ByteSource{
+
+public:
+    
+    virtual ~ByteSource() {}
+    
+    /*Opens the source, throws std::exception on failure*/
+    virtual void open(void) = 0;
+    
+    virtual bool isOpen(void) = 0;
+    
+    /*Blocks (up to the source's timeout) until data is available, then reads everything pending up to maxLen bytes into buf. Returns number of bytes read, 0 on timeout (or while a hung up source waits for its writer to come back)*/
+    virtual size_t read(uint8_t *buf, size_t maxLen) = 0;
+    
+    virtual void close(void) = 0;
+};
+
+class SerialByteSource : public ByteSource{
+
+public:
+    
+    SerialByteSource(const std::string &port, int baudRate);
+    
+    virtual void open(void);
+    
+    virtual bool isOpen(void);
+    
+    virtual size_t read(uint8_t *buf, size_t maxLen);
+    
+    virtual void close(void);
+
+private:
+    
+    serial::Serial mySerialObject;
+};
+
+/*Base for sources backed by a file descriptor that epoll can wait on*/
+class FdByteSource : public ByteSource{
+
+public:
+    
+    FdByteSource(const std::string &name);
+    
+    virtual ~FdByteSource();
+    
+    virtual bool isOpen(void);
+    
+    virtual size_t read(uint8_t *buf, size_t maxLen);
+    
+    virtual void close(void);
+
+protected:
+    
+    /*Switches fd to non-blocking and registers it with a new epoll instance, throws on failure*/
+    void watchFd(void);
+    
+    /*Closes everything and throws std::runtime_error with what and the errno text*/
+    void fail(const std::string &what);
+    
+    /*Port, path or address the source was created with*/
+    std::string sourceName;
+    
+    /*Source file descriptor, -1 when closed*/
+    int fd;
+    
+    /*epoll instance waiting for fd to become readable*/
+    int epollFd;
+};
+
+class TermiosByteSource : public FdByteSource{
+
+public:
+    
+    TermiosByteSource(const std::string &port, int baudRate);
+    
+    virtual void open(void);
+
+private:
+    
+    /*Sets ASYNC_LOW_LATENCY on the port and the FTDI latency timer if the device has one*/
+    void setLowLatency(void);
+    
+    int baudRate;
+};
+
+class FileByteSource : public ByteSource{
+
+public:
+    
+    FileByteSource(const std::string &path);
+    
+    virtual ~FileByteSource();
+    
+    virtual void open(void);
+    
+    virtual bool isOpen(void);
+    
+    /*Reads as fast as the file allows, returns 0 (after the read timeout) once the end of the capture is reached*/
+    virtual size_t read(uint8_t *buf, size_t maxLen);
+    
+    virtual void close(void);
+
+private:
+    
+    std::string path;
+    
+    int fd;
+    
+    bool endReported;
+};
+
+class TcpByteSource : public FdByteSource{
+
+public:
+    
+    /*address is "host:port"*/
+    TcpByteSource(const std::string &address);
+    
+    virtual void open(void);
+    
+    /*Like FdByteSource::read, but a closed or failed connection is reconnected (with backoff) instead of thrown*/
+    virtual size_t read(uint8_t *buf, size_t maxLen);
+    
+    virtual void close(void);
+
+private:
+    
+    /*Starts a non-blocking connect to the first address that takes it, throws if none does*/
+    void startConnect(void);
+    
+    /*Waits up to timeoutMs for the pending connect, returns false if it is still pending and throws if it failed*/
+    bool finishConnect(int timeoutMs);
+    
+    /*Socket options of an established connection*/
+    void connected(void);
+    
+    /*Closes the socket so the next read starts reconnecting*/
+    void dropConnection(void);
+    
+    /*Tries to open the connection again once the backoff delay has passed*/
+    void reconnect(void);
+    
+    /*Backoff delay after the next failed attempt*/
+    unsigned int retryDelayMs;
+    
+    /*CLOCK_MONOTONIC time of the next attempt*/
+    uint64_t nextRetryMs;
+    
+    /*A connect is pending, epoll waits for fd to become writable instead of readable*/
+    bool connecting;
+    
+    /*CLOCK_MONOTONIC time the pending connect counts as failed*/
+    uint64_t connectDeadlineMs;
+};
+
+class UdpByteSource : public FdByteSource{
+
+public:
+    
+    /*address is "port" or "host:port" to bind to*/
+    UdpByteSource(const std::string &address);
+    
+    virtual void open(void);
+};
+
+class PtyByteSource : public FdByteSource{
+
+public:
+    
+    /*linkPath (may be empty) is a symlink created to the slave side so writers can find it, an existing symlink there is
+      replaced but any other file is left alone and open() fails*/
+    PtyByteSource(const std::string &linkPath);
+    
+    virtual ~PtyByteSource();
+    
+    virtual void open(void);
+    
+    virtual void close(void);
+    
+    /*Name of the slave side of the pseudo-terminal, valid once open*/
+    const std::string &slaveName(void) const;
+
+private:
+    
+    std::string slave;
+    
+    /*Our own handle on the slave side, keeps the pseudo-terminal up between writers*/
+    int slaveFd;
+    
+    /*sourceName is a symlink this source created, removed again on close*/
+    bool linkCreated;
+};
+
+/*Creates the source for type ("serial", "termios", "file", "tcp", "udp" or "pty") reading from port, returns NULL for an unknown type*/
+ByteSource *createByteSource(const std::string &type, const std::string &port, int baudRate);
+
+#endif
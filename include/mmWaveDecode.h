@@ -0,0 +1,164 @@
+/*
+ * mmWaveDecode.h
+ *
+ * Batch decoders for the arrays carried in mmwDemo TLVs. They work on the
+ * raw (possibly unaligned) TLV payload and are independent of the
+ * DataUARTHandler threads, so they can be used on any captured packet.
+ *
+*/
+
+#ifndef _MMWAVE_DECODE_
+#define _MMWAVE_DECODE_
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <mmWaveTlv.h>
+#include <mmWaveFrameView.h>
+
+/*Lookup tables converting the uint16 fields of a detected object to physical units, indexed by the raw field value.
+  Built once per chirp configuration*/
+struct mmwUnitTables
+    {
+        mmwChirpConfig config;          /*!< @brief configuration the tables were built for */
+        std::vector<float> intensityDb; /*!< @brief peakVal -> 10*log10(peakVal + 1) */
+        std::vector<float> rangeMeters; /*!< @brief rangeIdx -> meters */
+        std::vector<float> dopplerMps;  /*!< @brief dopplerIdx -> m/s, indices above numDopplerBins/2-1 (or negative as int16) are negative velocities */
+    };
+
+/*Detected points in physical units and ROS coordinates (X forward, Y left, Z up) as a structure-of-arrays*/
+struct mmwDetectedPoints
+    {
+        std::vector<float> x;
+        std::vector<float> y;
+        std::vector<float> z;
+        std::vector<float> intensity;   /*!< @brief dB */
+        std::vector<float> range;       /*!< @brief meters */
+        std::vector<float> doppler;     /*!< @brief m/s */
+        std::vector<float> snr;         /*!< @brief dB, peak minus the noise floor at the point's range bin (0 without noise profile) */
+        std::vector<float> noise;       /*!< @brief dB, noise floor at the point's range bin (0 without noise profile) */
+    };
+
+/*Which detected points to keep. Bounds are inclusive, INFINITY / -INFINITY disable a gate*/
+struct mmwPointFilter
+    {
+        float elevationRatioSquared;    /*!< @brief tan^2 of the max elevation angle, keep if z^2 < elevationRatioSquared*(x^2+y^2) */
+        float azimuthRatio;             /*!< @brief tan of the max azimuth angle, keep if |y| < azimuthRatio*|x| */
+        float minRange;
+        float maxRange;
+        float minDoppler;
+        float maxDoppler;
+        float minIntensity;
+        float maxIntensity;
+    };
+
+/*Returns 1 if a point in ROS coordinates passes filter (and has x != 0), 0 otherwise, without branches*/
+static inline uint32_t pointPassesFilter(const mmwPointFilter &filter, float x, float y, float z, float range, float doppler, float intensity)
+{
+    return (uint32_t) ((z * z < filter.elevationRatioSquared * (x * x + y * y)) &
+                       (fabsf(y) < filter.azimuthRatio * fabsf(x)) &
+                       (x != 0) &
+                       (filter.minRange <= range) & (range <= filter.maxRange) &
+                       (filter.minDoppler <= doppler) & (doppler <= filter.maxDoppler) &
+                       (filter.minIntensity <= intensity) & (intensity <= filter.maxIntensity));
+}
+
+/*Decodes count packed MmwDemo_DetectedObj structures starting at src into objs, resizing its arrays to count*/
+void decodeDetectedObjs(const uint8_t *src, size_t count, mmwDetectedObjs &objs);
+
+/*Fills tables for config*/
+void buildUnitTables(const mmwChirpConfig &config, mmwUnitTables &tables);
+
+/*Converts objs to points, x/y/z with xyzScale (1/2^xyzQFormat, SSE2/AVX2/NEON when the compiler targets them, scalar otherwise)
+  and the other fields through tables, resizing the arrays of points. If noiseProfile is not NULL (the numNoiseBins Q9 log2
+  magnitudes of the noise profile TLV) SNR and noise of each point are looked up at its range bin in the same pass, the
+  peak value being a Q9 log2 magnitude of the same detection matrix*/
+void convertDetectedObjs(const mmwDetectedObjs &objs, float xyzScale, const mmwUnitTables &tables,
+                         const uint8_t *noiseProfile, size_t numNoiseBins, mmwDetectedPoints &points);
+
+/*Stores the indices of the points passing filter (and with x != 0) in selected, in order, and returns how many there are.
+  Uses multiplies and compares only, no branches per point*/
+size_t selectDetectedPoints(const mmwDetectedPoints &points, const mmwPointFilter &filter, std::vector<uint32_t> &selected);
+
+/*Decodes count SDK 2.x DPIF_PointCloudCartesian points at points and (if sideInfo is not NULL) their DPIF_PointCloudSideInfo
+  in one pass, straight into the PointT (RadarPoint or alike) array out, which needs room for count points. Points failing
+  filter are compacted away, returns how many are kept. Intensity is the SNR, as these points have no peak value*/
+template <typename PointT>
+size_t decodePointCloud(const uint8_t *points, const uint8_t *sideInfo, size_t count, const mmwPointFilter &filter, PointT *out)
+{
+    DPIF_PointCloudCartesian point;
+    DPIF_PointCloudSideInfo info;
+    size_t numKept = 0;
+    
+    info.snr = 0;
+    info.noise = 0;
+    
+    for(size_t i = 0; i < count; i++)
+    {
+        memcpy(&point, points + i * sizeof(point), sizeof(point));
+        if(sideInfo != NULL)
+        {
+            memcpy(&info, sideInfo + i * sizeof(info), sizeof(info));
+        }
+        
+        /*Every point is written, numKept only advances past the kept ones*/
+        PointT &p = out[numKept];
+        
+        // Map mmWave sensor coordinates to ROS coordinate system (X forward = sensor Y, Y left = sensor -X, Z up = sensor Z)
+        p.x = point.y;
+        p.y = -point.x;
+        p.z = point.z;
+        p.range = sqrtf(point.x * point.x + point.y * point.y + point.z * point.z);
+        p.doppler = point.velocity;
+        p.snr = info.snr * 0.1f;
+        p.noise = info.noise * 0.1f;
+        p.intensity = p.snr;
+        
+        numKept += pointPassesFilter(filter, p.x, p.y, p.z, p.range, p.doppler, p.intensity);
+    }
+    
+    return numKept;
+}
+
+/*Decodes the SDK 1.x detected objects TLV (numObj, xyzQFormat, then numObj MmwDemo_DetectedObj) into data.objOut, converts
+  them to points (SNR and noise from noiseProfile, an empty view if the packet has none) and selects the ones passing
+  filter, data.numObjOut being how many. Returns false, decoding nothing, if the TLV does not hold the objects it claims*/
+bool decodeDetectedObjsTlv(const FrameView &tlv, const FrameView &noiseProfile, const mmwUnitTables &tables, const mmwPointFilter &filter,
+                           mmwDataPacket &data, mmwDetectedPoints &points, std::vector<uint32_t> &selected);
+
+/*Decodes the numPoints (numDetectedObj of the header) points of an SDK 2.x detected points TLV with decodePointCloud into
+  out, a vector of PointT resized to the points passing filter. The side info TLV is used if it holds numPoints entries,
+  otherwise the points have no SNR and noise. Returns false, leaving out alone, if pointCloud does not hold numPoints points*/
+template <typename PointVector>
+bool decodePointCloudTlv(const FrameView &pointCloud, const FrameView &sideInfo, uint32_t numPoints, const mmwPointFilter &filter, PointVector &out)
+{
+    if(!pointCloud.contains(0, (size_t) numPoints * sizeof(DPIF_PointCloudCartesian)))
+    {
+        return false;
+    }
+    
+    out.resize(numPoints);
+    out.resize(decodePointCloud(pointCloud.data(),
+                                sideInfo.contains(0, (size_t) numPoints * sizeof(DPIF_PointCloudSideInfo)) ? sideInfo.data() : NULL,
+                                numPoints, filter, out.data()));
+    
+    return true;
+}
+
+/*Converts count Q9 log2 magnitudes (range and noise profiles) starting at src to dB in db, vectorized like convertDetectedObjs()*/
+void decodeLogMagProfile(const uint8_t *src, size_t count, float *db);
+
+/*Converts the numRangeBins x numDopplerBins Q9 log2 magnitude range/doppler heatmap at src (the doppler bins of a range
+  bin next to each other) to dB in db, one row per range bin. Each row is fftshifted, zero velocity ends up in column
+  numDopplerBins/2 with the approaching (negative doppler) bins left of it*/
+void decodeRangeDopplerHeatmap(const uint8_t *src, size_t numRangeBins, size_t numDopplerBins, float *db);
+
+/*Maps count values at src linearly from [min, max] of the values to [0, 255] into dst*/
+void normalizeToMono8(const float *src, size_t count, uint8_t *dst);
+
+/*Name of the instruction set convertDetectedObjs() and decodeLogMagProfile() were built for*/
+const char *convertDetectedObjsIsa(void);
+
+#endif
@@ -0,0 +1,48 @@
+/*
+ * mmWaveFrame.h
+ *
+ * This file defines the packet buffer passed from the DataUARTHandler read
+ * thread to the sort thread.
+ *
+*/
+
+#ifndef _MMWAVE_FRAME_
+#define _MMWAVE_FRAME_
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "ros/ros.h"
+#include "mmWaveFrameView.h"
+
+struct mmwStamp
+{
+    /*ROS time, used to stamp published messages*/
+    ros::Time rosTime;
+    
+    /*CLOCK_MONOTONIC time in ns, for latency measurements unaffected by clock adjustments*/
+    uint64_t monoNs;
+};
+
+struct mmwFrame
+{
+    /*Preallocated storage, bytes are read from the port straight into it*/
+    std::vector<uint8_t> data;
+    
+    /*Number of valid bytes in data*/
+    size_t len;
+    
+    /*When the read delivering the packet's first byte returned*/
+    mmwStamp arrival;
+    
+    /*CLOCK_MONOTONIC time in ns when the packet's magic word and header were recognized, 0 until then*/
+    uint64_t syncMonoNs;
+    
+    /*CLOCK_MONOTONIC time in ns when the read delivering the packet's last byte returned*/
+    uint64_t completeMonoNs;
+    
+    /*Position of the packet in the order the read thread queued packets, set when it is handed to a sort thread*/
+    uint64_t seq;
+};
+
+#endif
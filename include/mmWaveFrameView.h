@@ -0,0 +1,67 @@
+/*
+ * mmWaveFrameView.h
+ *
+ * This file defines a read-only view of received bytes, used to decode
+ * fields directly from a packet after checking their extent once. Has no
+ * ROS dependency.
+ *
+*/
+
+#ifndef _MMWAVE_FRAME_VIEW_
+#define _MMWAVE_FRAME_VIEW_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/*Read-only view of received bytes. Accesses are not bounds checked, callers check the extent of what they are about to
+  read once with contains() (e.g. a whole TLV or array) and then read it with get() or sub() without further checks*/
+class FrameView{
+    
+public:
+    
+    FrameView() : datap(NULL), length(0) {}
+    
+    FrameView(const uint8_t *data, size_t len) : datap(data), length(len) {}
+    
+    /*Returns true if the len bytes at offset lie inside the view (without overflowing for any offset/len)*/
+    bool contains(size_t offset, size_t len) const
+    {
+        return (offset <= length) && (len <= length - offset);
+    }
+    
+    /*Decodes a T stored (possibly unaligned) at offset, contains(offset, sizeof(T)) must hold*/
+    template <typename T>
+    T get(size_t offset) const
+    {
+        T value;
+        
+        memcpy(&value, datap + offset, sizeof(T));
+        
+        return value;
+    }
+    
+    /*Returns the view of the len bytes at offset, contains(offset, len) must hold*/
+    FrameView sub(size_t offset, size_t len) const
+    {
+        return FrameView(datap + offset, len);
+    }
+    
+    const uint8_t *data(void) const
+    {
+        return datap;
+    }
+    
+    size_t size(void) const
+    {
+        return length;
+    }
+    
+private:
+    
+    const uint8_t *datap;
+    
+    size_t length;
+};
+
+#endif
@@ -0,0 +1,116 @@
+/*
+ * mmWavePacket.h
+ *
+ * Finding and checking mmwDemo packets in the received byte stream, and
+ * walking the TLVs of a packet. Independent of the DataUARTHandler threads
+ * and of ROS, so the same code can be run over captured or synthetic
+ * streams.
+ *
+*/
+
+#ifndef _MMWAVE_PACKET_
+#define _MMWAVE_PACKET_
+
+#include <cstddef>
+#include <cstdint>
+#include "mmWaveTlv.h"
+#include "mmWaveFrameView.h"
+
+#define MAX_DETECTED_OBJ 512  //largest number of detected objects per packet used to size the packet buffers
+#define MAX_NUM_TLVS 32  //largest numTLVs accepted in a packet header
+#define MIN_HEADER_SIZE 28  //shortest packet header (XWR14xx), not including the magicWord
+#define PACKET_SEGMENT_LEN 32  //totalPacketLen is padded to a multiple of this
+#define MIN_FILLED_PACKET_PREFIX 4  //shortest magicWord start at the end of a packet the TLVs fill that holds it back
+
+/*Returns the largest totalPacketLen a device running config can send: header, every TLV the demo can output, and padding to the segment length*/
+uint32_t maxPacketLenFor(const mmwChirpConfig &config);
+
+/*Returns the layout (mmwPacketLayout) of the packets a device sends, MMW_LAYOUT_UNKNOWN for devices this driver does not know. New devices are added here*/
+int packetLayout(uint32_t version, uint32_t platform);
+
+/*Returns the header size (not including the magic word) for the given version and platform*/
+uint32_t packetHeaderSize(uint32_t version, uint32_t platform);
+
+/*Checks the header of the packet starting at packet (magic word included) and sets packetLen. Returns 1 if it is plausible
+  (packetLen not above maxPacketLen among others), 0 if not, -1 if len is too short to tell*/
+int checkPacketHeader(const uint8_t *packet, size_t len, uint32_t maxPacketLen, uint32_t &packetLen);
+
+/*Checks that every TLV of a complete packet ends inside the packet*/
+bool isValidTlvChain(const uint8_t *packet, uint32_t packetLen);
+
+/*Checks that the TLVs of a complete packet fill it, up to less than a segment of padding. Proves the packet is whole
+  without looking at the bytes after it*/
+bool tlvChainFillsPacket(const uint8_t *packet, uint32_t packetLen);
+
+/*Returns offset of the first valid packet header starting inside a packet (after its own magic word), or packetLen if there is none.
+  len is the number of bytes received so far (at least packetLen), undecided is set if a candidate runs past len and can not be checked yet:
+  a magic word whose header is not complete, or the first minPrefix or more bytes of a magic word at the end of the received bytes*/
+size_t findPacketStart(const uint8_t *packet, size_t packetLen, size_t len, uint32_t maxPacketLen, bool &undecided, size_t minPrefix = 1);
+
+/*Checks if the 8 bytes at bytes are the magic word*/
+int isMagicWord(const uint8_t *bytes);
+
+/*Returns offset of the first magic word in buf, or len if there is none*/
+size_t findMagicWord(const uint8_t *buf, size_t len);
+
+/*Reads the TLV at offset in frame into tlvType and tlv (a view of its payload) and moves offset past it. Returns false,
+  leaving offset as it is, if the TLV header or payload does not lie inside frame*/
+bool nextTlv(const FrameView &frame, uint32_t &offset, uint32_t &tlvType, FrameView &tlv);
+
+/*What mmwFramer::next() found at the front of the received bytes*/
+enum mmwFramerResult
+{
+    /*! @brief   No packet header yet, wait for more bytes */
+    MMW_FRAMER_NEED_DATA,
+    
+    /*! @brief   Packet header recognized, wait for the rest of the packet */
+    MMW_FRAMER_NEED_PAYLOAD,
+    
+    /*! @brief   Packet complete, but its last bytes may be the start of a next packet that begins inside it. Wait for
+                 more bytes, or call next() with decide set once they do not come */
+    MMW_FRAMER_UNDECIDED,
+    
+    /*! @brief   Drop the bytes in front of the next magicWord (or all but a possible start of one) */
+    MMW_FRAMER_SKIP,
+    
+    /*! @brief   Implausible header (corrupt packet or a magicWord inside payload data), drop its first byte */
+    MMW_FRAMER_BAD_HEADER,
+    
+    /*! @brief   The next packet starts inside this one (bytes were lost), drop up to the next packet */
+    MMW_FRAMER_CUT_SHORT,
+    
+    /*! @brief   TLVs do not add up to the packet, drop the packet */
+    MMW_FRAMER_BAD_TLVS,
+    
+    /*! @brief   Complete packet */
+    MMW_FRAMER_PACKET
+};
+
+/*Splits the byte stream into packets. The caller keeps the received bytes in a buffer and calls next() on them after
+  every read, and again after consuming what it returned, until it asks for more bytes*/
+class mmwFramer{
+
+public:
+    
+    mmwFramer(uint32_t maxPacketLen);
+    
+    /*Largest totalPacketLen accepted, packets claiming more are treated as corrupt*/
+    void setMaxPacketLen(uint32_t maxPacketLen);
+    
+    uint32_t getMaxPacketLen(void) const;
+    
+    /*Looks at the len bytes at buf, the start of the unconsumed stream, and sets n. Returns MMW_FRAMER_PACKET if the
+      first n bytes are a complete packet, MMW_FRAMER_NEED_DATA / MMW_FRAMER_NEED_PAYLOAD / MMW_FRAMER_UNDECIDED (n = 0)
+      if more bytes are needed, any other result if the first n bytes are to be dropped. With decide set, a packet
+      that would be MMW_FRAMER_UNDECIDED is taken as it is*/
+    int next(const uint8_t *buf, size_t len, size_t &n, bool decide = false);
+
+private:
+    
+    /*Set once the stream is known to start with a magicWord*/
+    bool synced;
+    
+    uint32_t maxPacketLen;
+};
+
+#endif
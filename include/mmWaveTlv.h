@@ -0,0 +1,176 @@
+/*
+ * mmWaveTlv.h
+ *
+ * Layout of the mmwDemo data stream: packet header, TLV types and the
+ * structures carried in TLVs. Plain structs without ROS or serial
+ * dependencies, so decoders, tests and tools can use them on their own.
+ *
+*/
+
+#ifndef _MMWAVE_TLV_
+#define _MMWAVE_TLV_
+
+#include <cstdint>
+#include <vector>
+
+enum MmwDemo_Output_TLV_Types
+{
+    MMWDEMO_OUTPUT_MSG_NULL = 0,
+    /*! @brief   List of detected points */
+    MMWDEMO_OUTPUT_MSG_DETECTED_POINTS,
+
+    /*! @brief   Range profile */
+    MMWDEMO_OUTPUT_MSG_RANGE_PROFILE,
+
+    /*! @brief   Noise floor profile */
+    MMWDEMO_OUTPUT_MSG_NOISE_PROFILE,
+
+    /*! @brief   Samples to calculate static azimuth  heatmap */
+    MMWDEMO_OUTPUT_MSG_AZIMUTH_STATIC_HEAT_MAP,
+
+    /*! @brief   Range/Doppler detection matrix */
+    MMWDEMO_OUTPUT_MSG_RANGE_DOPPLER_HEAT_MAP,
+
+    /*! @brief   Stats information */
+    MMWDEMO_OUTPUT_MSG_STATS,
+
+    /*! @brief   SNR and noise of each detected point (SDK 2.x and newer) */
+    MMWDEMO_OUTPUT_MSG_DETECTED_POINTS_SIDE_INFO,
+
+    MMWDEMO_OUTPUT_MSG_MAX
+};
+
+struct MmwDemo_output_message_header_t
+    {
+        /*! brief   Version: : MajorNum * 2^24 + MinorNum * 2^16 + BugfixNum * 2^8 + BuildNum   */
+        uint32_t    version;
+
+        /*! @brief   Total packet length including header in Bytes */
+        uint32_t    totalPacketLen;
+
+        /*! @brief   platform type */
+        uint32_t    platform;
+        
+        /*! @brief   Frame number */
+        uint32_t    frameNumber;
+
+        /*! @brief   Time in CPU cycles when the message was created. For XWR16xx: DSP CPU cycles, for XWR14xx: R4F CPU cycles */
+        uint32_t    timeCpuCycles;
+        
+        /*! @brief   Number of detected objects */
+        uint32_t    numDetectedObj;
+
+        /*! @brief   Number of TLVs */
+        uint32_t    numTLVs;
+
+        /*! @brief   Sub-frame Number (not used with XWR14xx) */
+        uint32_t    subFrameNumber;
+    };
+
+/*Packet layouts, the header size does not include the magicWord*/
+enum mmwPacketLayout
+{
+    /*! @brief   No subFrameNumber: XWR14xx, and every device with SDK older than 1.1 */
+    MMW_LAYOUT_SHORT_HEADER,
+
+    /*! @brief   subFrameNumber appended: XWR16xx, XWR18xx and XWR68xx with SDK 1.1 or newer */
+    MMW_LAYOUT_LONG_HEADER,
+
+    /*! @brief   Long header, float point cloud and a separate side info TLV: SDK 2.x and newer */
+    MMW_LAYOUT_SDK2,
+
+    MMW_LAYOUT_UNKNOWN
+};
+
+/*Compile-time description of each layout, the sort thread's parser is specialized on it*/
+template <int Layout> struct mmwLayoutTraits;
+
+template <> struct mmwLayoutTraits<MMW_LAYOUT_SHORT_HEADER>
+    {
+        enum { HEADER_SIZE = 28, HAS_SUB_FRAME_NUMBER = 0, FLOAT_POINT_CLOUD = 0 };
+    };
+
+template <> struct mmwLayoutTraits<MMW_LAYOUT_LONG_HEADER>
+    {
+        enum { HEADER_SIZE = 32, HAS_SUB_FRAME_NUMBER = 1, FLOAT_POINT_CLOUD = 0 };
+    };
+
+template <> struct mmwLayoutTraits<MMW_LAYOUT_SDK2>
+    {
+        enum { HEADER_SIZE = 32, HAS_SUB_FRAME_NUMBER = 1, FLOAT_POINT_CLOUD = 1 };
+    };
+
+struct MmwDemo_DetectedObj
+    {
+        uint16_t   rangeIdx;     /*!< @brief Range index */
+        uint16_t   dopplerIdx;   /*!< @brief Dopler index */
+        uint16_t   peakVal;      /*!< @brief Peak value */
+        int16_t  x;             /*!< @brief x - coordinate in meters. Q format depends on the range resolution */
+        int16_t  y;             /*!< @brief y - coordinate in meters. Q format depends on the range resolution */
+        int16_t  z;             /*!< @brief z - coordinate in meters. Q format depends on the range resolution */
+    };
+    
+/*Detected point of SDK 2.x and newer, in the sensor's coordinate system*/
+struct DPIF_PointCloudCartesian
+    {
+        float x;                /*!< @brief x - coordinate in meters */
+        float y;                /*!< @brief y - coordinate in meters */
+        float z;                /*!< @brief z - coordinate in meters */
+        float velocity;         /*!< @brief radial velocity in m/s */
+    };
+
+/*Side info of a detected point of SDK 2.x and newer*/
+struct DPIF_PointCloudSideInfo
+    {
+        int16_t snr;            /*!< @brief SNR in 0.1 dB */
+        int16_t noise;          /*!< @brief noise in 0.1 dB */
+    };
+
+/*Stats TLV, timing of the frame's processing on the device*/
+struct MmwDemo_output_message_stats
+    {
+        uint32_t interFrameProcessingTime;      /*!< @brief interframe processing time in usec */
+        uint32_t transmitOutputTime;            /*!< @brief transmission time of the previous frame's output in usec */
+        uint32_t interFrameProcessingMargin;    /*!< @brief interframe processing margin in usec */
+        uint32_t interChirpProcessingMargin;    /*!< @brief interchirp processing margin in usec */
+        uint32_t activeFrameCPULoad;            /*!< @brief CPU load (%) during active frame duration */
+        uint32_t interFrameCPULoad;             /*!< @brief CPU load (%) during inter frame duration */
+    };
+
+/*Detected objects of one packet as a structure-of-arrays, element i of every array belongs to object i*/
+struct mmwDetectedObjs
+    {
+        std::vector<uint16_t> rangeIdx;
+        std::vector<uint16_t> dopplerIdx;
+        std::vector<uint16_t> peakVal;
+        std::vector<int16_t>  x;
+        std::vector<int16_t>  y;
+        std::vector<int16_t>  z;
+    };
+
+/*Chirp configuration the sensor was set up with (mmWave_Manager parameters) and the units derived from it*/
+struct mmwChirpConfig
+    {
+        int numTxAnt;
+        int numRxAnt;
+        int numRangeBins;
+        int numDopplerBins;
+        float rangeIdxToMeters;
+        float dopplerResolutionToMps;
+    };
+
+struct mmwDataPacket{
+        
+    MmwDemo_output_message_header_t header;
+    
+    uint16_t numObjOut;
+    
+    uint16_t xyzQFormat;
+    
+    mmwDetectedObjs objOut;
+    
+};
+
+const uint8_t magicWord[8] = {2, 1, 4, 3, 6, 5, 8, 7};
+
+#endif
@@ -2,13 +2,15 @@
  * DataHandlerClass.cpp
  *
  * This is the implementation of the DataHandlerClass.h
- * Three threads are spawned when start() is called.
+ * Two threads are spawned when start() is called.
  *  1) readIncomingData() thread
  *  2) sortIncomingData() thread
- *  3) syncedBufferSwap() thread
  *  
- * Together they implement a double-buffered read from the data serial port 
- * which sorts the data into the class's mmwDataPacket struct.
+ * The read thread reads the data serial port straight into preallocated
+ * packet buffers and hands complete packets round-robin to the sort threads
+ * over lock-free queues. Each sort thread decodes its packets in place
+ * through a FrameView into its own mmwSortContext, the point clouds are
+ * published in the order the packets arrived.
  *
  *
  * Copyright (C) 2017 Texas Instruments Incorporated - http://www.ti.com/ 
@@ -46,6 +48,8 @@
 
 
 #include <DataHandlerClass.h>
+#include <mmWaveByteSource.h>
+#include <mmWaveDecode.h>
 #include <RadarPoint.h>
 #include <pthread.h>
 #include <algorithm>
@@ -53,18 +57,76 @@
 #include "sensor_msgs/PointField.h"
 #include "sensor_msgs/PointCloud2.h"
 #include "sensor_msgs/point_cloud2_iterator.h"
+#include "sensor_msgs/image_encodings.h"
 #include <pcl/io/pcd_io.h>
 #include <pcl/point_types.h>
 #include <cmath>
+#include <boost/bind.hpp>
+#include <cstring>
+#include <ctime>
+#include <cerrno>
 
 
-DataUARTHandler::DataUARTHandler(ros::NodeHandle* nh) : currentBufp(&pingPongBuffers[0]) , nextBufp(&pingPongBuffers[1]) 
+DataUARTHandler::DataUARTHandler(ros::NodeHandle* nh) : freeQueue(FRAME_POOL_SIZE) 
 {
     nodeHandle = nh;
     DataUARTHandler_pub = nodeHandle->advertise< sensor_msgs::PointCloud2 >("RScan", 100);
-    maxAllowedElevationAngleDeg = 90; // Use max angle if none specified
-    maxAllowedAzimuthAngleDeg = 90; // Use max angle if none specified
+    rangeProfile_pub = nodeHandle->advertise< ti_mmwave_rospkg::RangeProfile >("range_profile", 100);
+    rangeDopplerImage_pub = nodeHandle->advertise< sensor_msgs::Image >("range_doppler_heatmap", 10);
+    rangeDopplerMono_pub = nodeHandle->advertise< sensor_msgs::Image >("range_doppler_heatmap_mono8", 10);
+    azimuthImage_pub = nodeHandle->advertise< sensor_msgs::Image >("azimuth_heatmap", 10);
+    latency_pub = nodeHandle->advertise< ti_mmwave_rospkg::LatencyBudget >("latency_budget", 100);
+    setMaxAllowedElevationAngleDeg(90); // Use max angle if none specified
+    setMaxAllowedAzimuthAngleDeg(90); // Use max angle if none specified
+    setRangeLimits(-INFINITY, INFINITY); // Keep every range, doppler and intensity if no limits are specified
+    setDopplerLimits(-INFINITY, INFINITY);
+    setIntensityLimits(-INFINITY, INFINITY);
+    readBlockSize = 4096; // Largest number of bytes taken from the data port per read call
+    azimuthFftSize = 64; // Angle bins of the range/azimuth map if none specified
+    azimuthFftThreads = 1; // Compute the range/azimuth map on the sort thread if none specified
+    dataSource = "serial"; // Use the serial library if none specified
     
+    mmwChirpConfig config;
+    while(!readChirpConfig(config)){
+        // wait for params to be set
+    }
+    
+    /*Per-point unit conversions are table lookups, the tables are rebuilt only when the chirp configuration changes*/
+    boost::shared_ptr<mmwUnitTables> tables(new mmwUnitTables);
+    buildUnitTables(config, *tables);
+    unitTables = tables;
+    pthread_mutex_init(&unitTables_mutex, NULL);
+    
+    /*Packets claiming to be longer than this config allows are treated as corrupt*/
+    maxPacketLen = maxPacketLenFor(config);
+    
+    packetBufferGrowths = 0;
+    
+    sortThreads = 1; // Decode on a single sort thread if none specified
+    nextPacketSeq = 0;
+    nextPublishSeq = 0;
+    pthread_mutex_init(&freeQueue_mutex, NULL);
+    pthread_mutex_init(&publish_mutex, NULL);
+    pthread_cond_init(&publish_cond, NULL);
+    
+    /*TLVs decoded by default, every other type is skipped*/
+    registerTlvHandler(MMWDEMO_OUTPUT_MSG_DETECTED_POINTS, boost::bind(&DataUARTHandler::sortDetectedPoints, this, _1, _2));
+    registerTlvHandler(MMWDEMO_OUTPUT_MSG_DETECTED_POINTS_SIDE_INFO, boost::bind(&DataUARTHandler::sortSideInfo, this, _1, _2));
+    registerTlvHandler(MMWDEMO_OUTPUT_MSG_NOISE_PROFILE, boost::bind(&DataUARTHandler::sortNoiseProfile, this, _1, _2));
+    
+    /*Optional outputs, decoded while they have subscribers*/
+    registerTlvHandler(MMWDEMO_OUTPUT_MSG_RANGE_PROFILE, boost::bind(&DataUARTHandler::sortRangeProfile, this, _1, _2), rangeProfile_pub);
+    registerTlvHandler(MMWDEMO_OUTPUT_MSG_RANGE_DOPPLER_HEAT_MAP, boost::bind(&DataUARTHandler::sortRangeDopplerHeatmap, this, _1, _2), rangeDopplerImage_pub);
+    addTlvOutput(MMWDEMO_OUTPUT_MSG_RANGE_DOPPLER_HEAT_MAP, rangeDopplerMono_pub);
+    registerTlvHandler(MMWDEMO_OUTPUT_MSG_AZIMUTH_STATIC_HEAT_MAP, boost::bind(&DataUARTHandler::sortAzimuthHeatmap, this, _1, _2), azimuthImage_pub);
+    registerTlvHandler(MMWDEMO_OUTPUT_MSG_STATS, boost::bind(&DataUARTHandler::sortStats, this, _1, _2), latency_pub);
+    
+    ROS_INFO("Configured DataHandler numRangeBins: %d numDopplerBins: %d rangeIdxToM: %f dopplerResToMps: %f maxPacketLen: %u", config.numRangeBins, config.numDopplerBins, config.rangeIdxToMeters, config.dopplerResolutionToMps, maxPacketLen.load());
+    ROS_INFO("DataHandler point conversion built for %s", convertDetectedObjsIsa());
+}
+
+bool DataUARTHandler::readChirpConfig(mmwChirpConfig &config)
+{
     int numAdcSamples;
     int chirpEndIdx;
     int chirpStartIdx;
@@ -75,30 +137,73 @@ DataUARTHandler::DataUARTHandler(ros::NodeHandle* nh) : currentBufp(&pingPongBuf
     float idleTime;
     float rampEndTime;
     
-    int numTxAnt;
-    while(!nh->getParam("/mmWave_Manager/numTxAnt", numTxAnt)){
-        // wait for param to be set
+    /*numTxAnt is set last by mmWaveQuickConfig, the other params are only complete once it is there*/
+    if(!nodeHandle->getParamCached("/mmWave_Manager/numTxAnt", config.numTxAnt))
+    {
+        return false;
+    }
+    
+    nodeHandle->getParamCached("/mmWave_Manager/numAdcSamples", numAdcSamples);
+    nodeHandle->getParamCached("/mmWave_Manager/chirpEndIdx", chirpEndIdx);
+    nodeHandle->getParamCached("/mmWave_Manager/chirpStartIdx", chirpStartIdx);
+    nodeHandle->getParamCached("/mmWave_Manager/numLoops", numLoops);
+    nodeHandle->getParamCached("/mmWave_Manager/digOutSampleRate", digOutSampleRate);
+    nodeHandle->getParamCached("/mmWave_Manager/freqSlopeConst", freqSlopeConst);
+    nodeHandle->getParamCached("/mmWave_Manager/startFreq", startFreq);
+    nodeHandle->getParamCached("/mmWave_Manager/idleTime", idleTime);
+    nodeHandle->getParamCached("/mmWave_Manager/rampEndTime", rampEndTime);    
+    if(!nodeHandle->getParamCached("/mmWave_Manager/numRxAnt", config.numRxAnt))
+    {
+        config.numRxAnt = 4; // Assume all receive antennas are enabled if not specified
     }
-
-    nh->getParam("/mmWave_Manager/numAdcSamples", numAdcSamples);
-    nh->getParam("/mmWave_Manager/chirpEndIdx", chirpEndIdx);
-    nh->getParam("/mmWave_Manager/chirpStartIdx", chirpStartIdx);
-    nh->getParam("/mmWave_Manager/numLoops", numLoops);
-    nh->getParam("/mmWave_Manager/digOutSampleRate", digOutSampleRate);
-    nh->getParam("/mmWave_Manager/freqSlopeConst", freqSlopeConst);
-    nh->getParam("/mmWave_Manager/startFreq", startFreq);
-    nh->getParam("/mmWave_Manager/idleTime", idleTime);
-    nh->getParam("/mmWave_Manager/rampEndTime", rampEndTime);    
     
     int numChirpsPerFrame = (chirpEndIdx - chirpStartIdx + 1)*numLoops;
+    
+    config.numRangeBins = 1 << (int)std::ceil(std::log2(numAdcSamples));
+    config.numDopplerBins = numChirpsPerFrame/config.numTxAnt;
+    
+    config.rangeIdxToMeters = 300*digOutSampleRate/(2*freqSlopeConst*1e3*config.numRangeBins);
+    config.dopplerResolutionToMps = 3e8/(2*startFreq*1e9*(idleTime+rampEndTime)*1e-6*numChirpsPerFrame);
+    
+    return true;
+}
 
-    numRangeBins = 1 << (int)std::ceil(std::log2(numAdcSamples));
-    numDopplerBins = numChirpsPerFrame/numTxAnt;
+void DataUARTHandler::checkChirpConfig(const ros::TimerEvent &event)
+{
+    mmwChirpConfig config;
+    mmwChirpConfig current;
+    
+    if(!readChirpConfig(config))
+    {
+        return;
+    }
     
-    rangeIdxToMeters = 300*digOutSampleRate/(2*freqSlopeConst*1e3*numRangeBins);
-    dopplerResolutionToMps = 3e8/(2*startFreq*1e9*(idleTime+rampEndTime)*1e-6*numChirpsPerFrame);
+    pthread_mutex_lock(&unitTables_mutex);
+    current = unitTables->config;
+    pthread_mutex_unlock(&unitTables_mutex);
     
-    ROS_INFO("Configured DataHandler numRangeBins: %d numDopplerBins: %d rangeIdxToM: %f dopplerResToMps: %f", numRangeBins, numDopplerBins, rangeIdxToMeters, dopplerResolutionToMps);
+    if((config.numTxAnt == current.numTxAnt) &&
+       (config.numRxAnt == current.numRxAnt) &&
+       (config.numRangeBins == current.numRangeBins) &&
+       (config.numDopplerBins == current.numDopplerBins) &&
+       (config.rangeIdxToMeters == current.rangeIdxToMeters) &&
+       (config.dopplerResolutionToMps == current.dopplerResolutionToMps))
+    {
+        return;
+    }
+    
+    /*Build the new tables outside the lock, the sort thread picks them up with its next packet*/
+    boost::shared_ptr<mmwUnitTables> tables(new mmwUnitTables);
+    buildUnitTables(config, *tables);
+    
+    pthread_mutex_lock(&unitTables_mutex);
+    unitTables = tables;
+    pthread_mutex_unlock(&unitTables_mutex);
+    
+    /*The read thread checks packets against the new length from its next read on and grows its buffers to match*/
+    maxPacketLen = maxPacketLenFor(config);
+    
+    ROS_INFO("DataUARTHandler: Chirp configuration changed, numRangeBins: %d numDopplerBins: %d rangeIdxToM: %f dopplerResToMps: %f maxPacketLen: %u", config.numRangeBins, config.numDopplerBins, config.rangeIdxToMeters, config.dopplerResolutionToMps, maxPacketLen.load());
 }
 
 /*Implementation of setUARTPort*/
@@ -113,31 +218,188 @@ void DataUARTHandler::setBaudRate(int myBaudRate)
     dataBaudRate = myBaudRate;
 }
 
+/*Implementation of setDataSource*/
+void DataUARTHandler::setDataSource(const std::string &myDataSource)
+{
+    dataSource = myDataSource;
+}
+
 /*Implementation of setMaxAllowedElevationAngleDeg*/
 void DataUARTHandler::setMaxAllowedElevationAngleDeg(int myMaxAllowedElevationAngleDeg)
 {
     maxAllowedElevationAngleDeg = myMaxAllowedElevationAngleDeg;
+    
+    // Calculate ratio for max desired elevation angle, angles outside [0, 90) keep every elevation
+    if ((maxAllowedElevationAngleDeg >= 0) && (maxAllowedElevationAngleDeg < 90))
+    {
+        pointFilter.elevationRatioSquared = tan(maxAllowedElevationAngleDeg * M_PI / 180.0);
+        pointFilter.elevationRatioSquared = pointFilter.elevationRatioSquared * pointFilter.elevationRatioSquared;
+    }
+    else
+    {
+        pointFilter.elevationRatioSquared = INFINITY;
+    }
 }
 
 /*Implementation of setMaxAllowedAzimuthAngleDeg*/
 void DataUARTHandler::setMaxAllowedAzimuthAngleDeg(int myMaxAllowedAzimuthAngleDeg)
 {
     maxAllowedAzimuthAngleDeg = myMaxAllowedAzimuthAngleDeg;
+    
+    // Calculate ratio for max desired azimuth angle, angles outside [0, 90) keep every azimuth
+    if ((maxAllowedAzimuthAngleDeg >= 0) && (maxAllowedAzimuthAngleDeg < 90))
+    {
+        pointFilter.azimuthRatio = tan(maxAllowedAzimuthAngleDeg * M_PI / 180.0);
+    }
+    else
+    {
+        pointFilter.azimuthRatio = INFINITY;
+    }
+}
+
+/*Implementation of setRangeLimits*/
+void DataUARTHandler::setRangeLimits(float minRange, float maxRange)
+{
+    pointFilter.minRange = minRange;
+    pointFilter.maxRange = maxRange;
+}
+
+/*Implementation of setDopplerLimits*/
+void DataUARTHandler::setDopplerLimits(float minDoppler, float maxDoppler)
+{
+    pointFilter.minDoppler = minDoppler;
+    pointFilter.maxDoppler = maxDoppler;
+}
+
+/*Implementation of setIntensityLimits*/
+void DataUARTHandler::setIntensityLimits(float minIntensity, float maxIntensity)
+{
+    pointFilter.minIntensity = minIntensity;
+    pointFilter.maxIntensity = maxIntensity;
+}
+
+/*Implementation of setReadBlockSize*/
+void DataUARTHandler::setReadBlockSize(int myReadBlockSize)
+{
+    if(myReadBlockSize > 0)
+    {
+        readBlockSize = myReadBlockSize;
+    }
+}
+
+/*Implementation of setAzimuthFftSize*/
+void DataUARTHandler::setAzimuthFftSize(int myAzimuthFftSize)
+{
+    if((myAzimuthFftSize > 0) && !(myAzimuthFftSize & (myAzimuthFftSize - 1)))
+    {
+        azimuthFftSize = myAzimuthFftSize;
+    }
+    else
+    {
+        ROS_WARN("DataUARTHandler: azimuth FFT size %d is not a power of 2, keeping %u", myAzimuthFftSize, azimuthFftSize);
+    }
+}
+
+/*Implementation of setAzimuthFftThreads*/
+void DataUARTHandler::setAzimuthFftThreads(int myAzimuthFftThreads)
+{
+    azimuthFftThreads = std::max(1, myAzimuthFftThreads);
+}
+
+/*Implementation of setSortThreads*/
+void DataUARTHandler::setSortThreads(int mySortThreads)
+{
+    sortThreads = std::max(1, std::min(mySortThreads, MAX_SORT_THREADS));
+}
+
+/*Returns CLOCK_MONOTONIC time in ns*/
+static uint64_t monotonicNs(void)
+{
+    struct timespec ts;
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/*Arrival stamp of one read and the position of its first byte in the stream*/
+struct mmwReadStamp
+{
+    uint64_t start;
+    mmwStamp stamp;
+};
+
+/*Reads whose bytes are still in the packet buffer being filled, oldest first from head*/
+struct mmwReadStamps
+{
+    std::vector<mmwReadStamp> reads;
+    
+    size_t head;
+    
+    /*Position of the buffer's first byte in the stream*/
+    uint64_t bufferStart;
+};
+
+/*Updates the arrival stamp of a packet buffer whose new first byte is the byte at offset n, to the stamp of the read
+  that delivered that byte. Also when it came from an earlier read than the latest*/
+static void restamp(mmwFrame *framep, size_t n, mmwReadStamps &readStamps)
+{
+    std::vector<mmwReadStamp> &reads = readStamps.reads;
+    
+    readStamps.bufferStart += n;
+    while((readStamps.head + 1 < reads.size()) && (reads[readStamps.head + 1].start <= readStamps.bufferStart))
+    {
+        readStamps.head++;
+    }
+    
+    if(readStamps.head < reads.size())
+    {
+        framep->arrival = reads[readStamps.head].stamp;
+    }
+    
+    //reads before head are done with, the vector keeps its capacity
+    if(readStamps.head * 2 >= reads.size())
+    {
+        reads.erase(reads.begin(), reads.begin() + readStamps.head);
+        readStamps.head = 0;
+    }
+    
+    framep->syncMonoNs = 0;
+}
+
+/*Removes the first n bytes of a packet buffer*/
+static void dropFront(mmwFrame *framep, size_t n, mmwReadStamps &readStamps)
+{
+    memmove(&framep->data[0], &framep->data[n], framep->len - n);
+    framep->len -= n;
+    
+    restamp(framep, n, readStamps);
 }
 
 /*Implementation of readIncomingData*/
 void *DataUARTHandler::readIncomingData(void)
 {
     
-    int firstPacketReady = 0;
-    uint8_t last8Bytes[8] = {0};
+    unsigned int droppedPackets = 0;
+    unsigned int resyncCount = 0;
+    
+    /*Arrival stamp of the latest read, and of every read with bytes in nextFramep*/
+    mmwReadStamp chunkStamp;
+    mmwReadStamps readStamps;
+    readStamps.reads.reserve(256);
+    readStamps.head = 0;
+    readStamps.bufferStart = 0;
     
     /*Open UART Port and error checking*/
-    serial::Serial mySerialObject("", dataBaudRate, serial::Timeout::simpleTimeout(100));
-    mySerialObject.setPort(dataSerialPort);
+    boost::shared_ptr<ByteSource> mySource(createByteSource(dataSource, dataSerialPort, dataBaudRate));
+    if(!mySource)
+    {
+        ROS_ERROR("DataUARTHandler Read Thread: Unknown data source \"%s\"", dataSource.c_str());
+        pthread_exit(NULL);
+    }
     try
     {
-        mySerialObject.open();
+        mySource->open();
     } catch (std::exception &e1) {
         ROS_INFO("DataUARTHandler Read Thread: Failed to open Data serial port with error: %s", e1.what());
         ROS_INFO("DataUARTHandler Read Thread: Waiting 20 seconds before trying again...");
@@ -145,7 +407,7 @@ void *DataUARTHandler::readIncomingData(void)
         {
             // Wait 20 seconds and try to open serial port again
             ros::Duration(20).sleep();
-            mySerialObject.open();
+            mySource->open();
         } catch (std::exception &e2) {
             ROS_ERROR("DataUARTHandler Read Thread: Failed second time to open Data serial port, error: %s", e1.what());
             ROS_ERROR("DataUARTHandler Read Thread: Port could not be opened. Port is \"%s\" and baud rate is %d", dataSerialPort, dataBaudRate);
@@ -153,604 +415,817 @@ void *DataUARTHandler::readIncomingData(void)
         }
     }
     
-    if(mySerialObject.isOpen())
-        ROS_INFO("DataUARTHandler Read Thread: Port is open");
+    if(mySource->isOpen())
+        ROS_INFO("DataUARTHandler Read Thread: Port is open (%s data source)", dataSource.c_str());
     else
         ROS_ERROR("DataUARTHandler Read Thread: Port could not be opened");
     
-    /*Quick magicWord check to synchronize program with data Stream*/
-    while(!isMagicWord(last8Bytes))
-    {
-
-        last8Bytes[0] = last8Bytes[1];
-        last8Bytes[1] = last8Bytes[2];
-        last8Bytes[2] = last8Bytes[3];
-        last8Bytes[3] = last8Bytes[4];
-        last8Bytes[4] = last8Bytes[5];
-        last8Bytes[5] = last8Bytes[6];
-        last8Bytes[6] = last8Bytes[7];
-        mySerialObject.read(&last8Bytes[7], 1);
-        
-    }
+    /*Packet currently being filled*/
+    mmwFrame* nextFramep;
+    mmwFrame* fullFramep;
+    freeQueue.pop(nextFramep);
     
-    /*Lock nextBufp before entering main loop*/
-    pthread_mutex_lock(&nextBufp_mutex);
+    /*Finds the packets in nextFramep*/
+    mmwFramer framer(maxPacketLen);
+    int frameResult;
+    size_t frameLen;
+    size_t readLen;
+    size_t bufferSize;
+    uint64_t undecidedSinceNs = 0;
     
     while(ros::ok())
     {
-        /*Start reading UART data and writing to buffer while also checking for magicWord*/
-        last8Bytes[0] = last8Bytes[1];
-        last8Bytes[1] = last8Bytes[2];
-        last8Bytes[2] = last8Bytes[3];
-        last8Bytes[3] = last8Bytes[4];
-        last8Bytes[4] = last8Bytes[5];
-        last8Bytes[5] = last8Bytes[6];
-        last8Bytes[6] = last8Bytes[7];
-        mySerialObject.read(&last8Bytes[7], 1);
+        /*Follow a chirp configuration change*/
+        if(framer.getMaxPacketLen() != maxPacketLen.load(std::memory_order_relaxed))
+        {
+            framer.setMaxPacketLen(maxPacketLen.load(std::memory_order_relaxed));
+        }
         
-        nextBufp->push_back( last8Bytes[7] );  //push byte onto buffer
+        /*Packet buffers are sized for the active config, growing one is a heap allocation (once per buffer after the config grew)*/
+        bufferSize = std::max(nextFramep->len, (size_t) framer.getMaxPacketLen()) + readBlockSize;
+        if(bufferSize > nextFramep->data.size())
+        {
+            nextFramep->data.resize(bufferSize);
+            packetBufferGrowths++;
+            ROS_WARN("DataUARTHandler Read Thread: Packet buffer grew to %lu bytes (%lu packet buffer growths so far)", (unsigned long) bufferSize, packetBufferGrowths);
+        }
         
-        //ROS_INFO("DataUARTHandler Read Thread: last8bytes = %02x%02x %02x%02x %02x%02x %02x%02x",  last8Bytes[7], last8Bytes[6], last8Bytes[5], last8Bytes[4], last8Bytes[3], last8Bytes[2], last8Bytes[1], last8Bytes[0]);
+        /*Read everything pending (up to readBlockSize) straight into the packet buffer*/
+        try
+        {
+            readLen = mySource->read(&nextFramep->data[nextFramep->len], readBlockSize);
+        } catch (std::exception &e) {
+            ROS_ERROR("DataUARTHandler Read Thread: Failed to read Data serial port, error: %s", e.what());
+            break;
+        }
         
-        /*If a magicWord is found wait for sorting to finish and switch buffers*/
-        if( isMagicWord(last8Bytes) )
+        /*Stamp the read, a packet starting in this chunk arrived (at the latest) now*/
+        if(readLen > 0)
         {
-            //ROS_INFO("Found magic word");
+            chunkStamp.start = readStamps.bufferStart + nextFramep->len;
+            chunkStamp.stamp.rosTime = ros::Time::now();
+            chunkStamp.stamp.monoNs = monotonicNs();
+            readStamps.reads.push_back(chunkStamp);
+            if(nextFramep->len == 0)
+            {
+                nextFramep->arrival = chunkStamp.stamp;
+            }
+        }
+        nextFramep->len += readLen;
         
-            /*Lock countSync Mutex while unlocking nextBufp so that the swap thread can use it*/
-            pthread_mutex_lock(&countSync_mutex);
-            pthread_mutex_unlock(&nextBufp_mutex);
+        /*Hand off every packet that is complete in the buffer*/
+        while(ros::ok())
+        {
+            frameResult = framer.next(&nextFramep->data[0], nextFramep->len, frameLen);
+            
+            /*The packet's last bytes may start a packet inside it, give the bytes that tell a short while to come in
+              (they would be following right away), after that the packet is taken as complete*/
+            if(frameResult == MMW_FRAMER_UNDECIDED)
+            {
+                if(undecidedSinceNs == 0)
+                {
+                    undecidedSinceNs = chunkStamp.stamp.monoNs;
+                }
+                if(monotonicNs() - undecidedSinceNs < UNDECIDED_TIMEOUT_NS)
+                {
+                    break;
+                }
+                frameResult = framer.next(&nextFramep->data[0], nextFramep->len, frameLen, true);
+            }
+            undecidedSinceNs = 0;
             
-            /*increment countSync*/
-            countSync++;
+            if(frameResult == MMW_FRAMER_NEED_DATA)
+            {
+                break;
+            }
+            
+            /*Magic word and header recognized*/
+            if(((frameResult == MMW_FRAMER_NEED_PAYLOAD) || (frameResult == MMW_FRAMER_PACKET)) && (nextFramep->syncMonoNs == 0))
+            {
+                nextFramep->syncMonoNs = monotonicNs();
+            }
+            
+            if(frameResult == MMW_FRAMER_NEED_PAYLOAD)
+            {
+                break;
+            }
             
-            /*If this is the first packet to be found, increment countSync again since Sort thread is not reading data yet*/
-            if(firstPacketReady == 0)
+            if(frameResult == MMW_FRAMER_SKIP)
             {
-                countSync++;
-                firstPacketReady = 1;
+                dropFront(nextFramep, frameLen, readStamps);
+                continue;
             }
             
-            /*Signal Swap Thread to run if countSync has reached its max value*/
-            if(countSync == COUNT_SYNC_MAX)
+            if(frameResult == MMW_FRAMER_BAD_HEADER)
             {
-                pthread_cond_signal(&countSync_max_cv);
+                dropFront(nextFramep, frameLen, readStamps);
+                resyncCount++;
+                ROS_WARN("DataUARTHandler Read Thread: Invalid packet header, resynchronizing (%u resyncs so far)", resyncCount);
+                continue;
             }
             
-            /*Wait for the Swap thread to finish swapping pointers and signal us to continue*/
-            pthread_cond_wait(&read_go_cv, &countSync_mutex);
+            if(frameResult == MMW_FRAMER_CUT_SHORT)
+            {
+                dropFront(nextFramep, frameLen, readStamps);
+                resyncCount++;
+                ROS_WARN("DataUARTHandler Read Thread: Packet cut short by the next packet, resynchronizing (%u resyncs so far)", resyncCount);
+                continue;
+            }
+            
+            if(frameResult == MMW_FRAMER_BAD_TLVS)
+            {
+                dropFront(nextFramep, frameLen, readStamps);
+                resyncCount++;
+                ROS_WARN("DataUARTHandler Read Thread: Corrupt TLVs, dropped packet (%u resyncs so far)", resyncCount);
+                continue;
+            }
+            
+            //ROS_INFO("Packet complete");
             
-            /*Unlock countSync so that Swap Thread can use it*/
-            pthread_mutex_unlock(&countSync_mutex);
-            pthread_mutex_lock(&nextBufp_mutex);
+            /*Everything after the packet (at most one read) is carried over to a free buffer for the next packet*/
+            if(freeQueue.pop(fullFramep))
+            {
+                memcpy(&fullFramep->data[0], &nextFramep->data[frameLen], nextFramep->len - frameLen);
+                fullFramep->len = nextFramep->len - frameLen;
+                restamp(fullFramep, frameLen, readStamps);
+                std::swap(fullFramep, nextFramep);
+                fullFramep->len = frameLen;
+                fullFramep->completeMonoNs = chunkStamp.stamp.monoNs;
+                
+                /*Packets go round-robin to the sort threads, the sequence number puts their point clouds back in order*/
+                fullFramep->seq = nextPacketSeq;
+                mmwSortContext &worker = *sortWorkers[nextPacketSeq++ % sortWorkers.size()];
+                worker.frameQueue.push(fullFramep);
+                sem_post(&worker.frameQueue_sem);
+            }
             
-            nextBufp->clear();
-            memset(last8Bytes, 0, sizeof(last8Bytes));
-              
+            /*If the sort threads still hold every other buffer drop the packet and keep filling this one*/
+            else
+            {
+                dropFront(nextFramep, frameLen, readStamps);
+                droppedPackets++;
+                ROS_WARN("DataUARTHandler Read Thread: Sort threads are behind, dropped packet (%u dropped so far)", droppedPackets);
+            }
         }
-      
+    
     }
     
     
-    mySerialObject.close();
+    mySource->close();
     
     pthread_exit(NULL);
 }
 
 
-int DataUARTHandler::isMagicWord(uint8_t last8Bytes[8])
+/*Prepares msg for the packet being sorted. Nodelet subscribers get published messages without a copy and may still
+  hold the last one, which is then left to them and replaced by a fresh one. A message nobody else holds is reused*/
+template <typename M>
+static void recycleMessage(boost::shared_ptr<M> &msg)
+{
+    if(msg.use_count() != 1)
+    {
+        msg.reset(new M);
+    }
+}
+
+void *DataUARTHandler::sortIncomingData(mmwSortContext &ctx)
 {
-    int val = 0, i = 0, j = 0;
+    /*Read-only view of the packet being sorted, fields are decoded from it in place*/
+    FrameView frame;
     
-    for(i = 0; i < 8 ; i++)
+    while(ros::ok())
     {
+        /*Hand the sorted packet's buffer back to the read thread and wait for it to queue the next one*/
+        if(ctx.currentFramep != NULL)
+        {
+            pthread_mutex_lock(&freeQueue_mutex);  //the sort threads take turns as the free queue's single producer
+            freeQueue.push(ctx.currentFramep);
+            pthread_mutex_unlock(&freeQueue_mutex);
+            ctx.currentFramep = NULL;
+        }
+        
+        if(!waitForPacket(ctx))
+        {
+            continue;
+        }
+        
+        frame = FrameView(&ctx.currentFramep->data[0], ctx.currentFramep->len);
+        
+        /*Every packet is decoded with one set of unit tables, even if the chirp configuration changes meanwhile*/
+        pthread_mutex_lock(&unitTables_mutex);
+        ctx.sortTables = unitTables;
+        pthread_mutex_unlock(&unitTables_mutex);
+        
+        /*Parser specialized on the packet layout, chosen from the first valid header*/
+        ctx.RScanReady = false;
+        ctx.rangeProfileReady = false;
+        ctx.rangeDopplerImageReady = false;
+        ctx.rangeDopplerMonoReady = false;
+        ctx.azimuthImageReady = false;
+        ctx.latencyWanted = (latency_pub.getNumSubscribers() > 0);
+        ctx.latencyReady = false;
+        if(ctx.latencyWanted)
+        {
+            recycleMessage(ctx.latency);  //the stats TLV and finishLatency fill it in
+        }
+        ctx.statsSeen = false;
+        ctx.parseStartNs = monotonicNs();
+        (this->*ctx.sortPacket)(ctx, frame);
+        ctx.parseEndNs = monotonicNs();
+        
+        /*Every packet takes its turn, also the dropped ones, so later packets never wait for it*/
+        publishInOrder(ctx);
+    }
     
-       if( last8Bytes[i] == magicWord[i])
-       {
-          j++;
-       }
+    pthread_exit(NULL);
+}
+
+void DataUARTHandler::selectPacketLayout(mmwSortContext &ctx, const FrameView &frame)
+{
+    uint32_t version;
+    uint32_t platform;
     
+    //make sure packet has the magicWord and at least first three fields (12 bytes) before we read them
+    if(!frame.contains(0, sizeof(magicWord) + 12))
+    {
+        return;
     }
     
-    if( j == 8)
+    version = frame.get<uint32_t>(sizeof(magicWord));
+    platform = frame.get<uint32_t>(sizeof(magicWord) + 8);
+    
+    switch(packetLayout(version, platform))
     {
-       val = 1;
+    case MMW_LAYOUT_SHORT_HEADER:
+        ctx.sortPacket = &DataUARTHandler::sortPacketAs<MMW_LAYOUT_SHORT_HEADER>;
+        break;
+    case MMW_LAYOUT_LONG_HEADER:
+        ctx.sortPacket = &DataUARTHandler::sortPacketAs<MMW_LAYOUT_LONG_HEADER>;
+        break;
+    case MMW_LAYOUT_SDK2:
+        ctx.sortPacket = &DataUARTHandler::sortPacketAs<MMW_LAYOUT_SDK2>;
+        break;
+    default:
+        return;
     }
     
-    return val;  
+    ctx.layoutVersion = version;
+    ctx.layoutPlatform = platform;
+    
+    ROS_INFO("DataUARTHandler Sort Thread: Device xWR%04x with SDK %u.%u.%u, header %u bytes", platform & 0xFFFF, (version >> 24) & 0xFF, (version >> 16) & 0xFF, (version >> 8) & 0xFF, packetHeaderSize(version, platform));
+    
+    (this->*ctx.sortPacket)(ctx, frame);
 }
 
-void *DataUARTHandler::syncedBufferSwap(void)
+template <int Layout>
+void DataUARTHandler::sortPacketAs(mmwSortContext &ctx, const FrameView &frame)
 {
-    while(ros::ok())
+    uint32_t currentDatap = sizeof(magicWord);  //packets start with the magicWord
+    
+    //make sure packet has the magicWord and the whole header before we read it
+    if(!frame.contains(0, sizeof(magicWord) + mmwLayoutTraits<Layout>::HEADER_SIZE))
+    {
+        return;
+    }
+    
+    //get version (4 bytes)
+    ctx.mmwData.header.version = frame.get<uint32_t>(currentDatap);
+    currentDatap += ( sizeof(ctx.mmwData.header.version) );
+    
+    //get totalPacketLen (4 bytes)
+    ctx.mmwData.header.totalPacketLen = frame.get<uint32_t>(currentDatap);
+    currentDatap += ( sizeof(ctx.mmwData.header.totalPacketLen) );
+    
+    //get platform (4 bytes)
+    ctx.mmwData.header.platform = frame.get<uint32_t>(currentDatap);
+    currentDatap += ( sizeof(ctx.mmwData.header.platform) );      
+    
+    //a different device or SDK is streaming now, choose the parser again
+    if((ctx.mmwData.header.version != ctx.layoutVersion) || (ctx.mmwData.header.platform != ctx.layoutPlatform))
+    {
+        selectPacketLayout(ctx, frame);
+        return;
+    }
+    
+    //get frameNumber (4 bytes)
+    ctx.mmwData.header.frameNumber = frame.get<uint32_t>(currentDatap);
+    currentDatap += ( sizeof(ctx.mmwData.header.frameNumber) );
+    
+    //get timeCpuCycles (4 bytes)
+    ctx.mmwData.header.timeCpuCycles = frame.get<uint32_t>(currentDatap);
+    currentDatap += ( sizeof(ctx.mmwData.header.timeCpuCycles) );
+    
+    //get numDetectedObj (4 bytes)
+    ctx.mmwData.header.numDetectedObj = frame.get<uint32_t>(currentDatap);
+    currentDatap += ( sizeof(ctx.mmwData.header.numDetectedObj) );
+    
+    //get numTLVs (4 bytes)
+    ctx.mmwData.header.numTLVs = frame.get<uint32_t>(currentDatap);
+    currentDatap += ( sizeof(ctx.mmwData.header.numTLVs) );
+    
+    //get subFrameNumber (4 bytes) (only in the longer header)
+    if(mmwLayoutTraits<Layout>::HAS_SUB_FRAME_NUMBER)
+    {
+       ctx.mmwData.header.subFrameNumber = frame.get<uint32_t>(currentDatap);
+       currentDatap += ( sizeof(ctx.mmwData.header.subFrameNumber) );
+    }
+    
+    //if packet lengths do not match, throw it away
+    if(ctx.mmwData.header.totalPacketLen != frame.size())
     {
-        pthread_mutex_lock(&countSync_mutex);
+        return;
+    }
+    
+    ctx.latencyReady = ctx.latencyWanted;
+    
+    ctx.pointCloudTlv = FrameView();
+    ctx.sideInfoTlv = FrameView();
+    ctx.noiseProfileTlv = FrameView();
+    
+    sortTlvs(ctx, frame, currentDatap);
     
-        while(countSync < COUNT_SYNC_MAX)
+    /*Points need the side info or noise profile, which come after them in the packet*/
+    if(ctx.pointCloudTlv.size() > 0)
+    {
+        if(mmwLayoutTraits<Layout>::FLOAT_POINT_CLOUD)
         {
-            pthread_cond_wait(&countSync_max_cv, &countSync_mutex);
-            
-            pthread_mutex_lock(&currentBufp_mutex);
-            pthread_mutex_lock(&nextBufp_mutex);
-            
-            std::vector<uint8_t>* tempBufp = currentBufp;
-        
-            this->currentBufp = this->nextBufp;
-            
-            this->nextBufp = tempBufp;
-            
-            pthread_mutex_unlock(&currentBufp_mutex);
-            pthread_mutex_unlock(&nextBufp_mutex);
-            
-            countSync = 0;
-            
-            pthread_cond_signal(&sort_go_cv);
-            pthread_cond_signal(&read_go_cv);
-            
+            sortPointCloud(ctx);
+        }
+        else
+        {
+            sortDetectedObjs(ctx);
         }
+    }
     
-        pthread_mutex_unlock(&countSync_mutex);
-
+    if(ctx.rangeProfileReady)
+    {
+        sortRangeNoise(ctx);
     }
+}
 
-    pthread_exit(NULL);
+void DataUARTHandler::sortTlvs(mmwSortContext &ctx, const FrameView &frame, uint32_t currentDatap)
+{
+    uint32_t tlvType;
+    uint32_t tlvCount;
+    FrameView tlv;
     
+    /*Hand every TLV to the handler registered for its type, TLVs without a handler or subscribers are skipped.
+      Each TLV is checked to lie inside the packet once, handlers get a view of just its payload*/
+    for(tlvCount = 0; tlvCount < ctx.mmwData.header.numTLVs; tlvCount++)
+    {
+        if(!nextTlv(frame, currentDatap, tlvType, tlv))
+        {
+            ROS_WARN("DataUARTHandler Sort Thread: Packet %u is truncated, dropped", ctx.mmwData.header.frameNumber);
+            return;
+        }
+        
+        //ROS_INFO("DataUARTHandler Sort Thread : tlvType = %d, tlvLen = %d", (int) tlvType, (int) tlv.size());
+        
+        /*Optional outputs cost nothing but the skip while nobody subscribes to them*/
+        if((tlvType < tlvHandlers.size()) && tlvHandlers[tlvType] && tlvWanted(tlvType))
+        {
+            tlvHandlers[tlvType](ctx, tlv);
+        }
+    }
 }
 
-void *DataUARTHandler::sortIncomingData( void )
+void DataUARTHandler::sortDetectedPoints(mmwSortContext &ctx, const FrameView &tlv)
 {
-    MmwDemo_Output_TLV_Types tlvType = MMWDEMO_OUTPUT_MSG_NULL;
-    uint32_t tlvLen = 0;
-    uint32_t headerSize;
-    unsigned int currentDatap = 0;
-    SorterState sorterState = READ_HEADER;
-    int i = 0, tlvCount = 0, offset = 0;
-    float maxElevationAngleRatioSquared;
-    float maxAzimuthAngleRatio;
-    
-    boost::shared_ptr<pcl::PointCloud<RadarPoint>> RScan(new pcl::PointCloud<RadarPoint>);
+    //decoded together with their side info or noise profile once every TLV of the packet has been seen
+    ctx.pointCloudTlv = tlv;
+}
+
+void DataUARTHandler::sortDetectedObjs(mmwSortContext &ctx)
+{
+    int i;
+    int k;
     
-    //wait for first packet to arrive
-    pthread_mutex_lock(&countSync_mutex);
-    pthread_cond_wait(&sort_go_cv, &countSync_mutex);
-    pthread_mutex_unlock(&countSync_mutex);
+    //decode, convert to meters, m/s and dB in the ROS coordinate system and select the points inside the field of view
+    //and gates, the noise profile (guiMonitor setting) is optional, points get SNR and noise 0 if it is missing
+    if(!decodeDetectedObjsTlv(ctx.pointCloudTlv, ctx.noiseProfileTlv, *ctx.sortTables, pointFilter, ctx.mmwData, ctx.points, ctx.selectedPoints))
+    {
+        ROS_WARN("DataUARTHandler Sort Thread: Detected points TLV of packet %u is truncated, ignored", ctx.mmwData.header.frameNumber);
+        return;
+    }
     
-    pthread_mutex_lock(&currentBufp_mutex);
+    recycleMessage(ctx.RScan);
+    ctx.RScan->points.resize(ctx.mmwData.numObjOut);
     
-    while(ros::ok())
+    for(i = 0; i < ctx.mmwData.numObjOut; i++)
     {
+        k = ctx.selectedPoints[i];
         
-        switch(sorterState)
-        {
-            
-        case READ_HEADER:
-            
-            //make sure packet has at least first three fields (12 bytes) before we read them (does not include magicWord since it was already removed)
-            if(currentBufp->size() < 12)
-            {
-               sorterState = SWAP_BUFFERS;
-               break;
-            }
-            
-            //get version (4 bytes)
-            memcpy( &mmwData.header.version, &currentBufp->at(currentDatap), sizeof(mmwData.header.version));
-            currentDatap += ( sizeof(mmwData.header.version) );
-            
-            //get totalPacketLen (4 bytes)
-            memcpy( &mmwData.header.totalPacketLen, &currentBufp->at(currentDatap), sizeof(mmwData.header.totalPacketLen));
-            currentDatap += ( sizeof(mmwData.header.totalPacketLen) );
-            
-            //get platform (4 bytes)
-            memcpy( &mmwData.header.platform, &currentBufp->at(currentDatap), sizeof(mmwData.header.platform));
-            currentDatap += ( sizeof(mmwData.header.platform) );      
-            
-            //if packet doesn't have correct header size (which is based on platform and SDK version), throw it away (does not include magicWord since it was already removed)
-	    if((((mmwData.header.version >> 24) & 0xFF) < 1) || (((mmwData.header.version >> 16) & 0xFF) < 1))  //check if SDK version is older than 1.1
-	    {
-               //ROS_INFO("mmWave device firmware detected version: 0x%8.8X", mmwData.header.version);
-	       headerSize = 28;
-	    }
-            else if((mmwData.header.platform & 0xFFFF) == 0x1443)
-	    {
-	       headerSize = 28;
-	    }
-	    else  // 1642
-	    {
-	       headerSize = 32;
-	    }
-            if(currentBufp->size() < headerSize)
-            {
-               sorterState = SWAP_BUFFERS;
-               break;
-            }
-            
-            //get frameNumber (4 bytes)
-            memcpy( &mmwData.header.frameNumber, &currentBufp->at(currentDatap), sizeof(mmwData.header.frameNumber));
-            currentDatap += ( sizeof(mmwData.header.frameNumber) );
-            
-            //get timeCpuCycles (4 bytes)
-            memcpy( &mmwData.header.timeCpuCycles, &currentBufp->at(currentDatap), sizeof(mmwData.header.timeCpuCycles));
-            currentDatap += ( sizeof(mmwData.header.timeCpuCycles) );
-            
-            //get numDetectedObj (4 bytes)
-            memcpy( &mmwData.header.numDetectedObj, &currentBufp->at(currentDatap), sizeof(mmwData.header.numDetectedObj));
-            currentDatap += ( sizeof(mmwData.header.numDetectedObj) );
-            
-            //get numTLVs (4 bytes)
-            memcpy( &mmwData.header.numTLVs, &currentBufp->at(currentDatap), sizeof(mmwData.header.numTLVs));
-            currentDatap += ( sizeof(mmwData.header.numTLVs) );
-            
-            //get subFrameNumber (4 bytes) (not used for XWR1443)
-            if((mmwData.header.platform & 0xFFFF) != 0x1443)
-	    {
-               memcpy( &mmwData.header.subFrameNumber, &currentBufp->at(currentDatap), sizeof(mmwData.header.subFrameNumber));
-               currentDatap += ( sizeof(mmwData.header.subFrameNumber) );
-	    }
-
-            //if packet lengths do not patch, throw it away
-            if(mmwData.header.totalPacketLen == currentBufp->size() )
-            {
-               sorterState = CHECK_TLV_TYPE;
-            }
-            else sorterState = SWAP_BUFFERS;
+        ctx.RScan->points[i].x = ctx.points.x[k];
+        ctx.RScan->points[i].y = ctx.points.y[k];
+        ctx.RScan->points[i].z = ctx.points.z[k];
+        ctx.RScan->points[i].intensity = ctx.points.intensity[k];
+        ctx.RScan->points[i].range = ctx.points.range[k];
+        ctx.RScan->points[i].doppler = ctx.points.doppler[k];
+        ctx.RScan->points[i].snr = ctx.points.snr[k];
+        ctx.RScan->points[i].noise = ctx.points.noise[k];
+        
+        //ROS_INFO("x %f y %f z %f intensity %f range %d %f doppler %d %f", ctx.RScan->points[i].x, ctx.RScan->points[i].y, ctx.RScan->points[i].z, ctx.RScan->points[i].intensity, ctx.mmwData.objOut.rangeIdx[k], ctx.RScan->points[i].range, ctx.mmwData.objOut.dopplerIdx[k], ctx.RScan->points[i].doppler);
+    }
+    
+    //ROS_INFO("mmwData.numObjOut after = %d", ctx.mmwData.numObjOut);
+    //ROS_INFO("DataUARTHandler Sort Thread: number of obj = %d", ctx.mmwData.numObjOut );
+    
+    finishRScan(ctx);
+}
 
-            break;
-            
-        case READ_OBJ_STRUCT:
-            
-            i = 0;
-            offset = 0;
-            
-            //get number of objects
-            memcpy( &mmwData.numObjOut, &currentBufp->at(currentDatap), sizeof(mmwData.numObjOut));
-            currentDatap += ( sizeof(mmwData.numObjOut) );
-            
-            //get xyzQFormat
-            memcpy( &mmwData.xyzQFormat, &currentBufp->at(currentDatap), sizeof(mmwData.xyzQFormat));
-            currentDatap += ( sizeof(mmwData.xyzQFormat) );
-            
-            RScan->header.seq = 0;
-            //RScan->header.stamp = (uint32_t) mmwData.header.timeCpuCycles;
-            RScan->header.frame_id = "base_radar_link";
-            RScan->height = 1;
-            RScan->width = mmwData.numObjOut;
-            RScan->is_dense = 1;
-            RScan->points.resize(RScan->width * RScan->height);
-            
-            // Calculate ratios for max desired elevation and azimuth angles
-            if ((maxAllowedElevationAngleDeg >= 0) && (maxAllowedElevationAngleDeg < 90))
-            {
-                maxElevationAngleRatioSquared = tan(maxAllowedElevationAngleDeg * M_PI / 180.0);
-                maxElevationAngleRatioSquared = maxElevationAngleRatioSquared * maxElevationAngleRatioSquared;
-            }
-            else
-            {
-                maxElevationAngleRatioSquared = -1;
-            }
-            if ((maxAllowedAzimuthAngleDeg >= 0) && (maxAllowedAzimuthAngleDeg < 90))
-            {
-                maxAzimuthAngleRatio = tan(maxAllowedAzimuthAngleDeg * M_PI / 180.0);
-            }
-            else
-            {
-                maxAzimuthAngleRatio = -1;
-            }
-            //ROS_INFO("----");
-            //ROS_INFO("maxElevationAngleRatioSquared = %f", maxElevationAngleRatioSquared);
-            //ROS_INFO("maxAzimuthAngleRatio = %f", maxAzimuthAngleRatio);
-            //ROS_INFO("mmwData.numObjOut before = %d", mmwData.numObjOut);
+void DataUARTHandler::sortSideInfo(mmwSortContext &ctx, const FrameView &tlv)
+{
+    //decoded together with the points once every TLV of the packet has been seen
+    ctx.sideInfoTlv = tlv;
+}
 
+void DataUARTHandler::sortNoiseProfile(mmwSortContext &ctx, const FrameView &tlv)
+{
+    //used by the points and the range profile once every TLV of the packet has been seen
+    ctx.noiseProfileTlv = tlv;
+}
 
-            //set some parameters for pointcloud
-            while( i < mmwData.numObjOut )
-            {
-                //get object range index
-                memcpy( &mmwData.objOut.rangeIdx, &currentBufp->at(currentDatap), sizeof(mmwData.objOut.rangeIdx));
-                currentDatap += ( sizeof(mmwData.objOut.rangeIdx) );
-                
-                //get object doppler index
-                memcpy( &mmwData.objOut.dopplerIdx, &currentBufp->at(currentDatap), sizeof(mmwData.objOut.dopplerIdx));
-                currentDatap += ( sizeof(mmwData.objOut.dopplerIdx) );
-                
-                //get object peak intensity value
-                memcpy( &mmwData.objOut.peakVal, &currentBufp->at(currentDatap), sizeof(mmwData.objOut.peakVal));
-                currentDatap += ( sizeof(mmwData.objOut.peakVal) );
-                
-                //get object x-coordinate
-                memcpy( &mmwData.objOut.x, &currentBufp->at(currentDatap), sizeof(mmwData.objOut.x));
-                currentDatap += ( sizeof(mmwData.objOut.x) );
-                
-                //get object y-coordinate
-                memcpy( &mmwData.objOut.y, &currentBufp->at(currentDatap), sizeof(mmwData.objOut.y));
-                currentDatap += ( sizeof(mmwData.objOut.y) );
-                
-                //get object z-coordinate
-                memcpy( &mmwData.objOut.z, &currentBufp->at(currentDatap), sizeof(mmwData.objOut.z));
-                currentDatap += ( sizeof(mmwData.objOut.z) );
-                
-                //convert from Qformat to float(meters)
-                int data[6];
-                data[0] = mmwData.objOut.x;
-                data[1] = mmwData.objOut.y;
-                data[2] = mmwData.objOut.z;
-                data[3] = mmwData.objOut.peakVal;
-                data[4] = mmwData.objOut.rangeIdx;
-                data[5] = mmwData.objOut.dopplerIdx;
-                for(int j = 0; j < 6; j++)
-                {
-                    if(data[j] > 32767)
-                        data[j] -= 65535;
-                }
-                
-                float temp[6];
-                for(int j = 0; j < 3; j++)
-                {
-                    temp[j] = ((float)data[j]) / pow(2,mmwData.xyzQFormat);
-                 }   
-                 
-                // Convert intensity to dB
-                temp[3] = 10 * log10(data[3] + 1);  // intensity
-                
-                // Convert rangeIdx to meters
-                temp[4] = data[4] * rangeIdxToMeters;
-                
-                // Convert dopplerIdx to meters per second
-                if(data[5] > numDopplerBins/2-1){
-                    data[5] -= numDopplerBins;
-                }
-                temp[5] = data[5] * dopplerResolutionToMps;
-                
-                // Map mmWave sensor coordinates to ROS coordinate system
-                RScan->points[i].x = temp[1];   // ROS standard coordinate system X-axis is forward which is the mmWave sensor Y-axis
-                RScan->points[i].y = -temp[0];  // ROS standard coordinate system Y-axis is left which is the mmWave sensor -(X-axis)
-                RScan->points[i].z = temp[2];   // ROS standard coordinate system Z-axis is up which is the same as mmWave sensor Z-axis
-                RScan->points[i].intensity = temp[3];
-                RScan->points[i].range = temp[4];
-                RScan->points[i].doppler = temp[5];
-               
-                //ROS_INFO("x %f y %f z %f intensity %f range %d %f doppler %d %f", RScan->points[i].x, RScan->points[i].y, RScan->points[i].z, RScan->points[i].intensity, mmwData.objOut.rangeIdx, RScan->points[i].range, mmwData.objOut.dopplerIdx, RScan->points[i].doppler);
-               
-                // Keep point if elevation and azimuth angles are less than specified max values
-                // (NOTE: The following calculations are done using ROS standard coordinate system axis definitions where X is forward and Y is left)
-                if (((maxElevationAngleRatioSquared == -1) ||
-                     (((RScan->points[i].z * RScan->points[i].z) / (RScan->points[i].x * RScan->points[i].x +
-                                                                    RScan->points[i].y * RScan->points[i].y)
-                      ) < maxElevationAngleRatioSquared)
-                    ) &&
-                    ((maxAzimuthAngleRatio == -1) || (fabs(RScan->points[i].y / RScan->points[i].x) < maxAzimuthAngleRatio)) &&
-		            (RScan->points[i].x != 0)
-                   )
-                {
-                    //ROS_INFO("Kept point");
-                    i++;
-                }
+void DataUARTHandler::sortPointCloud(mmwSortContext &ctx)
+{
+    //decode points and side info (guiMonitor setting, optional) straight into the point cloud, keeping the points inside
+    //the field of view and gates
+    recycleMessage(ctx.RScan);
+    if(!decodePointCloudTlv(ctx.pointCloudTlv, ctx.sideInfoTlv, ctx.mmwData.header.numDetectedObj, pointFilter, ctx.RScan->points))
+    {
+        ROS_WARN("DataUARTHandler Sort Thread: Detected points TLV of packet %u is truncated, ignored", ctx.mmwData.header.frameNumber);
+        return;
+    }
+    ctx.mmwData.numObjOut = ctx.RScan->points.size();
+    
+    finishRScan(ctx);
+}
 
-                // Otherwise, remove the point
-                else
-                {
-                    //ROS_INFO("Removed point");
-                    mmwData.numObjOut--;
-                }
-            }
+void DataUARTHandler::finishRScan(mmwSortContext &ctx)
+{
+    ctx.RScan->header.seq = 0;
+    ctx.RScan->header.stamp = ctx.currentFramep->arrival.rosTime.toNSec() / 1000ull;  //PCL stamps are in microseconds
+    ctx.RScan->header.frame_id = "base_radar_link";
+    ctx.RScan->height = 1;
+    ctx.RScan->width = ctx.RScan->points.size();
+    ctx.RScan->is_dense = 1;
+    
+    ctx.RScanReady = true;
+}
 
-            // Resize point cloud since some points may have been removed
-            RScan->width = mmwData.numObjOut;
-            RScan->points.resize(RScan->width * RScan->height);
-            
-            //ROS_INFO("mmwData.numObjOut after = %d", mmwData.numObjOut);
-            //ROS_INFO("DataUARTHandler Sort Thread: number of obj = %d", mmwData.numObjOut );
-            
-            DataUARTHandler_pub.publish(RScan);
-            
-            sorterState = CHECK_TLV_TYPE;
-            
-            break;
-            
-        case READ_LOG_MAG_RANGE:
-            {
-        
-              i = 0;
-            
-              while (i++ < tlvLen - 1)
-              {
-                     //ROS_INFO("DataUARTHandler Sort Thread : Parsing Range Profile i=%d and tlvLen = %u", i, tlvLen);
-              }
-            
-              currentDatap += tlvLen;
-            
-              sorterState = CHECK_TLV_TYPE;
-            }
-            
-            break;
-            
-        case READ_NOISE:
-            {
-        
-              i = 0;
-            
-              while (i++ < tlvLen - 1)
-              {
-                     //ROS_INFO("DataUARTHandler Sort Thread : Parsing Noise Profile i=%d and tlvLen = %u", i, tlvLen);
-              }
-            
-              currentDatap += tlvLen;
-            
-              sorterState = CHECK_TLV_TYPE;
-            }
-           
-            break;
-            
-        case READ_AZIMUTH:
-            {
-        
-              i = 0;
-            
-              while (i++ < tlvLen - 1)
-              {
-                     //ROS_INFO("DataUARTHandler Sort Thread : Parsing Azimuth Profile i=%d and tlvLen = %u", i, tlvLen);
-              }
-            
-              currentDatap += tlvLen;
-            
-              sorterState = CHECK_TLV_TYPE;
-            }
-            
-            break;
-            
-        case READ_DOPPLER:
-            {
-        
-              i = 0;
-            
-              while (i++ < tlvLen - 1)
-              {
-                     //ROS_INFO("DataUARTHandler Sort Thread : Parsing Doppler Profile i=%d and tlvLen = %u", i, tlvLen);
-              }
-            
-              currentDatap += tlvLen;
-            
-              sorterState = CHECK_TLV_TYPE;
-            }
-            
-            break;
-            
-        case READ_STATS:
-            {
-        
-              i = 0;
-            
-              while (i++ < tlvLen - 1)
-              {
-                     //ROS_INFO("DataUARTHandler Sort Thread : Parsing Stats Profile i=%d and tlvLen = %u", i, tlvLen);
-              }
-            
-              currentDatap += tlvLen;
-            
-              sorterState = CHECK_TLV_TYPE;
-            }
-            
-            break;
-        
-        case CHECK_TLV_TYPE:
-        
-            //ROS_INFO("DataUARTHandler Sort Thread : tlvCount = %d, numTLV = %d", tlvCount, mmwData.header.numTLVs);
+void DataUARTHandler::sortRangeProfile(mmwSortContext &ctx, const FrameView &tlv)
+{
+    recycleMessage(ctx.rangeProfile);
+    ti_mmwave_rospkg::RangeProfile &profile = *ctx.rangeProfile;
+    
+    /*One Q9 log2 magnitude per range bin, range bins past the unit tables cannot be converted*/
+    size_t numBins = std::min(tlv.size() / sizeof(uint16_t), ctx.sortTables->rangeMeters.size());
+    
+    if(numBins == 0)
+    {
+        return;
+    }
+    
+    profile.header.stamp = ctx.currentFramep->arrival.rosTime;
+    profile.header.frame_id = "base_radar_link";
+    profile.frame_number = ctx.mmwData.header.frameNumber;
+    
+    //a recycled message does not allocate once it has held the longest profile
+    profile.range.resize(numBins);
+    profile.power.resize(numBins);
+    
+    memcpy(&profile.range[0], &ctx.sortTables->rangeMeters[0], numBins * sizeof(float));
+    decodeLogMagProfile(tlv.data(), numBins, &profile.power[0]);
+    profile.noise.clear();
+    
+    ctx.rangeProfileReady = true;
+}
+
+void DataUARTHandler::sortRangeNoise(mmwSortContext &ctx)
+{
+    ti_mmwave_rospkg::RangeProfile &profile = *ctx.rangeProfile;
+    size_t numBins = profile.power.size();
+    
+    /*One Q9 log2 magnitude per range bin, like the range profile*/
+    if(ctx.noiseProfileTlv.size() / sizeof(uint16_t) < numBins)
+    {
+        return;
+    }
+    
+    profile.noise.resize(numBins);
+    decodeLogMagProfile(ctx.noiseProfileTlv.data(), numBins, &profile.noise[0]);
+}
+
+/*Sets up image as a height x width image with pixels of pixelSize bytes for the packet being sorted.
+  A recycled message does not allocate once it has held the largest image*/
+static void setupImage(sensor_msgs::Image &image, const mmwFrame *framep, uint32_t height, uint32_t width,
+                       const std::string &encoding, uint32_t pixelSize)
+{
+    image.header.stamp = framep->arrival.rosTime;
+    image.header.frame_id = "base_radar_link";
+    image.height = height;
+    image.width = width;
+    image.encoding = encoding;
+    image.is_bigendian = 0;
+    image.step = width * pixelSize;
+    image.data.resize(height * image.step);
+}
+
+void DataUARTHandler::sortRangeDopplerHeatmap(mmwSortContext &ctx, const FrameView &tlv)
+{
+    uint32_t numRangeBins = ctx.sortTables->config.numRangeBins;
+    uint32_t numDopplerBins = ctx.sortTables->config.numDopplerBins;
+    float *db;
+    
+    /*One uint16 per range and doppler bin of the configuration the unit tables were built for*/
+    if((numRangeBins == 0) || (numDopplerBins == 0) || (tlv.size() != numRangeBins * numDopplerBins * sizeof(uint16_t)))
+    {
+        ROS_WARN_THROTTLE(10, "DataUARTHandler Sort Thread: Range/doppler heatmap of packet %u does not match the chirp configuration, ignored", ctx.mmwData.header.frameNumber);
+        return;
+    }
+    
+    /*Rows are range bins, columns doppler bins with zero velocity in the middle*/
+    recycleMessage(ctx.rangeDopplerImage);
+    setupImage(*ctx.rangeDopplerImage, ctx.currentFramep, numRangeBins, numDopplerBins, sensor_msgs::image_encodings::TYPE_32FC1, sizeof(float));
+    db = reinterpret_cast<float *>(&ctx.rangeDopplerImage->data[0]);
+    decodeRangeDopplerHeatmap(tlv.data(), numRangeBins, numDopplerBins, db);
+    ctx.rangeDopplerImageReady = true;
+    
+    if(rangeDopplerMono_pub.getNumSubscribers() > 0)
+    {
+        recycleMessage(ctx.rangeDopplerMono);
+        setupImage(*ctx.rangeDopplerMono, ctx.currentFramep, numRangeBins, numDopplerBins, sensor_msgs::image_encodings::MONO8, sizeof(uint8_t));
+        normalizeToMono8(db, numRangeBins * numDopplerBins, &ctx.rangeDopplerMono->data[0]);
+        ctx.rangeDopplerMonoReady = true;
+    }
+}
+
+void DataUARTHandler::sortStats(mmwSortContext &ctx, const FrameView &tlv)
+{
+    ti_mmwave_rospkg::LatencyBudget &latency = *ctx.latency;
+    MmwDemo_output_message_stats stats;
+    
+    if(!tlv.contains(0, sizeof(stats)))
+    {
+        ROS_WARN_THROTTLE(10, "DataUARTHandler Sort Thread: Stats TLV of packet %u is truncated, ignored", ctx.mmwData.header.frameNumber);
+        return;
+    }
+    
+    stats = tlv.get<MmwDemo_output_message_stats>(0);
+    
+    //device times are in usec
+    latency.device_processing = stats.interFrameProcessingTime * 1e-3f;
+    latency.device_processing_margin = stats.interFrameProcessingMargin * 1e-3f;
+    latency.device_chirp_margin = stats.interChirpProcessingMargin * 1e-3f;
+    latency.device_transmit_previous = stats.transmitOutputTime * 1e-3f;
+    latency.active_frame_cpu_load = stats.activeFrameCPULoad;
+    latency.inter_frame_cpu_load = stats.interFrameCPULoad;
+    
+    ctx.statsSeen = true;
+}
+
+void DataUARTHandler::finishLatency(mmwSortContext &ctx, uint64_t publishTimeNs)
+{
+    ti_mmwave_rospkg::LatencyBudget &latency = *ctx.latency;
+    const mmwFrame *framep = ctx.currentFramep;
+    
+    if(!ctx.statsSeen)
+    {
+        latency.device_processing = 0;
+        latency.device_processing_margin = 0;
+        latency.device_chirp_margin = 0;
+        latency.device_transmit_previous = 0;
+        latency.active_frame_cpu_load = 0;
+        latency.inter_frame_cpu_load = 0;
+    }
+    
+    latency.header.stamp = framep->arrival.rosTime;
+    latency.header.frame_id = "base_radar_link";
+    latency.frame_number = ctx.mmwData.header.frameNumber;
+    
+    //host times are CLOCK_MONOTONIC ns
+    latency.uart_transfer = (framep->completeMonoNs - framep->arrival.monoNs) * 1e-6f;
+    latency.sync = (framep->syncMonoNs - framep->arrival.monoNs) * 1e-6f;
+    latency.queue = (ctx.parseStartNs - framep->completeMonoNs) * 1e-6f;
+    latency.parse = (ctx.parseEndNs - ctx.parseStartNs) * 1e-6f;
+    latency.publish = (publishTimeNs - ctx.parseEndNs) * 1e-6f;
+    latency.total = latency.device_processing + (publishTimeNs - framep->arrival.monoNs) * 1e-6f;
+    
+    //start, data and stop bit per byte
+    if(((dataSource == "serial") || (dataSource == "termios")) && (dataBaudRate > 0))
+    {
+        latency.uart_transfer_expected = framep->len * 10 * 1e3f / dataBaudRate;
+    }
+    else
+    {
+        latency.uart_transfer_expected = 0;
+    }
+}
+
+void DataUARTHandler::sortAzimuthHeatmap(mmwSortContext &ctx, const FrameView &tlv)
+{
+    uint32_t numRangeBins = ctx.sortTables->config.numRangeBins;
+    uint32_t rowSize = numRangeBins * 2 * sizeof(int16_t);
+    uint32_t numAntennas;
+    
+    /*numRangeBins rows of one cmplx16ImRe_t per azimuth virtual antenna, the antenna count follows from the size*/
+    if((rowSize == 0) || (tlv.size() == 0) || (tlv.size() % rowSize != 0))
+    {
+        ROS_WARN_THROTTLE(10, "DataUARTHandler Sort Thread: Azimuth heatmap of packet %u does not match the chirp configuration, ignored", ctx.mmwData.header.frameNumber);
+        return;
+    }
+    numAntennas = tlv.size() / rowSize;
+    
+    //twiddles and window are only recomputed if the antennas change
+    if((ctx.angleFft.getNumAntennas() != numAntennas) || (ctx.angleFft.getFftSize() != azimuthFftSize))
+    {
+        if(!ctx.angleFft.configure(numAntennas, azimuthFftSize))
+        {
+            ROS_WARN_THROTTLE(10, "DataUARTHandler Sort Thread: Azimuth FFT size %u is smaller than the %u azimuth antennas, heatmap ignored", azimuthFftSize, numAntennas);
+            return;
+        }
+    }
+    
+    /*Rows are range bins, columns angle bins with broadside in the middle*/
+    recycleMessage(ctx.azimuthImage);
+    setupImage(*ctx.azimuthImage, ctx.currentFramep, numRangeBins, azimuthFftSize, sensor_msgs::image_encodings::TYPE_32FC1, sizeof(float));
+    ctx.angleFft.compute(tlv.data(), numRangeBins, reinterpret_cast<float *>(&ctx.azimuthImage->data[0]), azimuthFftThreads);
+    ctx.azimuthImageReady = true;
+}
+
+void DataUARTHandler::publishInOrder(mmwSortContext &ctx)
+{
+    uint64_t seq = ctx.currentFramep->seq;
+    struct timespec timeout;
+    
+    pthread_mutex_lock(&publish_mutex);
+    
+    /*Wait for the sort threads holding earlier packets, waking up at least every 100 ms to check ros::ok()*/
+    while((nextPublishSeq != seq) && ros::ok())
+    {
+        clock_gettime(CLOCK_REALTIME, &timeout);
+        timeout.tv_nsec += 100000000;
+        if(timeout.tv_nsec >= 1000000000)
+        {
+            timeout.tv_sec++;
+            timeout.tv_nsec -= 1000000000;
+        }
         
-            if(tlvCount++ >= mmwData.header.numTLVs)
-            {
-                //ROS_INFO("DataUARTHandler Sort Thread : CHECK_TLV_TYPE state says tlvCount max was reached, going to switch buffer state");
-                sorterState = SWAP_BUFFERS;
-            }
-            else
-            {
-               //get tlvType (32 bits) & remove from queue
-                memcpy( &tlvType, &currentBufp->at(currentDatap), sizeof(tlvType));
-                currentDatap += ( sizeof(tlvType) );
-                
-                //ROS_INFO("DataUARTHandler Sort Thread : sizeof(tlvType) = %d", sizeof(tlvType));
-            
-                //get tlvLen (32 bits) & remove from queue
-                memcpy( &tlvLen, &currentBufp->at(currentDatap), sizeof(tlvLen));
-                currentDatap += ( sizeof(tlvLen) );
-                
-                //ROS_INFO("DataUARTHandler Sort Thread : sizeof(tlvLen) = %d", sizeof(tlvLen));
-                
-                //ROS_INFO("DataUARTHandler Sort Thread : tlvType = %d, tlvLen = %d", (int) tlvType, tlvLen);
-            
-                switch(tlvType)
-                {
-                case MMWDEMO_OUTPUT_MSG_NULL:
-                
-                    break;
-                
-                case MMWDEMO_OUTPUT_MSG_DETECTED_POINTS:
-                    //ROS_INFO("DataUARTHandler Sort Thread : Object TLV");
-                    sorterState = READ_OBJ_STRUCT;
-                    break;
-                
-                case MMWDEMO_OUTPUT_MSG_RANGE_PROFILE:
-                    //ROS_INFO("DataUARTHandler Sort Thread : Range TLV");
-                    sorterState = READ_LOG_MAG_RANGE;
-                    break;
-                
-                case MMWDEMO_OUTPUT_MSG_NOISE_PROFILE:
-                    //ROS_INFO("DataUARTHandler Sort Thread : Noise TLV");
-                    sorterState = READ_NOISE;
-                    break;
-                
-                case MMWDEMO_OUTPUT_MSG_AZIMUTH_STATIC_HEAT_MAP:
-                    //ROS_INFO("DataUARTHandler Sort Thread : Azimuth Heat TLV");
-                    sorterState = READ_AZIMUTH;
-                    break;
-                
-                case MMWDEMO_OUTPUT_MSG_RANGE_DOPPLER_HEAT_MAP:
-                    //ROS_INFO("DataUARTHandler Sort Thread : R/D Heat TLV");
-                    sorterState = READ_DOPPLER;
-                    break;
-                
-                case MMWDEMO_OUTPUT_MSG_STATS:
-                    //ROS_INFO("DataUARTHandler Sort Thread : Stats TLV");
-                    sorterState = READ_STATS;
-                    break;
-                
-                case MMWDEMO_OUTPUT_MSG_MAX:
-                    //ROS_INFO("DataUARTHandler Sort Thread : Header TLV");
-                    sorterState = READ_HEADER;
-                    break;
-                
-                default: break;
-                }
-            }
-            
-        break;
-            
-       case SWAP_BUFFERS:
-       
-            pthread_mutex_lock(&countSync_mutex);
-            pthread_mutex_unlock(&currentBufp_mutex);
-                            
-            countSync++;
-                
-            if(countSync == COUNT_SYNC_MAX)
-            {
-                pthread_cond_signal(&countSync_max_cv);
-            }
-                
-            pthread_cond_wait(&sort_go_cv, &countSync_mutex);
-                
-            pthread_mutex_unlock(&countSync_mutex);
-            pthread_mutex_lock(&currentBufp_mutex);
-                
-            currentDatap = 0;
-            tlvCount = 0;
-                
-            sorterState = READ_HEADER;
-            
-            break;
-                
-            
-        default: break;
+        pthread_cond_timedwait(&publish_cond, &publish_mutex, &timeout);
+    }
+    
+    if(ctx.RScanReady)
+    {
+        DataUARTHandler_pub.publish(ctx.RScan);
+        ctx.RScanReady = false;
+    }
+    
+    if(ctx.rangeProfileReady)
+    {
+        rangeProfile_pub.publish(ctx.rangeProfile);
+        ctx.rangeProfileReady = false;
+    }
+    
+    if(ctx.rangeDopplerImageReady)
+    {
+        rangeDopplerImage_pub.publish(ctx.rangeDopplerImage);
+        ctx.rangeDopplerImageReady = false;
+    }
+    
+    if(ctx.rangeDopplerMonoReady)
+    {
+        rangeDopplerMono_pub.publish(ctx.rangeDopplerMono);
+        ctx.rangeDopplerMonoReady = false;
+    }
+    
+    if(ctx.azimuthImageReady)
+    {
+        azimuthImage_pub.publish(ctx.azimuthImage);
+        ctx.azimuthImageReady = false;
+    }
+    
+    if(ctx.latencyReady)
+    {
+        finishLatency(ctx, monotonicNs());
+        latency_pub.publish(ctx.latency);
+        ctx.latencyReady = false;
+    }
+    
+    nextPublishSeq = seq + 1;
+    pthread_cond_broadcast(&publish_cond);
+    
+    pthread_mutex_unlock(&publish_mutex);
+}
+
+void DataUARTHandler::registerTlvHandler(uint32_t tlvType, const TlvHandler &handler)
+{
+    if(tlvType >= tlvHandlers.size())
+    {
+        tlvHandlers.resize(tlvType + 1);
+        tlvOutputs.resize(tlvType + 1);
+    }
+    
+    tlvHandlers[tlvType] = handler;
+    tlvOutputs[tlvType].clear();
+}
+
+void DataUARTHandler::registerTlvHandler(uint32_t tlvType, const TlvHandler &handler, const ros::Publisher &output)
+{
+    registerTlvHandler(tlvType, handler);
+    addTlvOutput(tlvType, output);
+}
+
+void DataUARTHandler::addTlvOutput(uint32_t tlvType, const ros::Publisher &output)
+{
+    if(tlvType < tlvOutputs.size())
+    {
+        tlvOutputs[tlvType].push_back(output);
+    }
+}
+
+bool DataUARTHandler::tlvWanted(uint32_t tlvType)
+{
+    const std::vector<ros::Publisher> &outputs = tlvOutputs[tlvType];
+    
+    if(outputs.empty())
+    {
+        return true;
+    }
+    
+    for(size_t i = 0; i < outputs.size(); i++)
+    {
+        if(outputs[i].getNumSubscribers() > 0)
+        {
+            return true;
         }
     }
     
+    return false;
+}
+
+bool DataUARTHandler::waitForPacket(mmwSortContext &ctx)
+{
+    struct timespec timeout;
     
-    pthread_exit(NULL);
+    /*Wake up at least every 100 ms to check ros::ok()*/
+    while(ros::ok())
+    {
+        clock_gettime(CLOCK_REALTIME, &timeout);
+        timeout.tv_nsec += 100000000;
+        if(timeout.tv_nsec >= 1000000000)
+        {
+            timeout.tv_sec++;
+            timeout.tv_nsec -= 1000000000;
+        }
+        
+        if(sem_timedwait(&ctx.frameQueue_sem, &timeout) == 0)
+        {
+            return ctx.frameQueue.pop(ctx.currentFramep);
+        }
+    }
+    
+    return false;
 }
 
 void DataUARTHandler::start(void)
 {
     
-    pthread_t uartThread, sorterThread, swapThread;
+    pthread_t uartThread;
     
-    int  iret1, iret2, iret3;
+    int  iret1, iret2;
     
-    pthread_mutex_init(&countSync_mutex, NULL);
-    pthread_mutex_init(&nextBufp_mutex, NULL);
-    pthread_mutex_init(&currentBufp_mutex, NULL);
-    pthread_cond_init(&countSync_max_cv, NULL);
-    pthread_cond_init(&read_go_cv, NULL);
-    pthread_cond_init(&sort_go_cv, NULL);
+    /*One decoding context per sort thread, each with its own packet queue*/
+    sortWorkers.resize(sortThreads);
+    for(size_t i = 0; i < sortWorkers.size(); i++)
+    {
+        sortWorkers[i].reset(new mmwSortContext);
+        sortWorkers[i]->handler = this;
+        sem_init(&sortWorkers[i]->frameQueue_sem, 0, 0);
+        sortWorkers[i]->sortPacket = &DataUARTHandler::selectPacketLayout;
+        sortWorkers[i]->RScan.reset(new pcl::PointCloud<RadarPoint>);
+        sortWorkers[i]->RScanReady = false;
+        sortWorkers[i]->rangeProfile.reset(new ti_mmwave_rospkg::RangeProfile);
+        sortWorkers[i]->rangeProfileReady = false;
+        sortWorkers[i]->rangeDopplerImage.reset(new sensor_msgs::Image);
+        sortWorkers[i]->rangeDopplerImageReady = false;
+        sortWorkers[i]->rangeDopplerMono.reset(new sensor_msgs::Image);
+        sortWorkers[i]->rangeDopplerMonoReady = false;
+        sortWorkers[i]->azimuthImage.reset(new sensor_msgs::Image);
+        sortWorkers[i]->azimuthImageReady = false;
+        sortWorkers[i]->latency.reset(new ti_mmwave_rospkg::LatencyBudget);
+        sortWorkers[i]->latencyWanted = false;
+        sortWorkers[i]->latencyReady = false;
+    }
     
-    countSync = 0;
+    /*Allocate every packet buffer up front, with room for a packet plus the start of the next read*/
+    framePool.resize(FRAME_QUEUE_SIZE + 1 + sortWorkers.size());
+    for(size_t i = 0; i < framePool.size(); i++)
+    {
+        framePool[i].data.resize(maxPacketLen.load() + readBlockSize);
+        framePool[i].len = 0;
+        framePool[i].syncMonoNs = 0;
+        framePool[i].completeMonoNs = 0;
+        freeQueue.push(&framePool[i]);
+    }
     
     /* Create independent threads each of which will execute function */
     iret1 = pthread_create( &uartThread, NULL, this->readIncomingData_helper, this);
@@ -760,37 +1235,36 @@ void DataUARTHandler::start(void)
      ros::shutdown();
     }
     
-    iret2 = pthread_create( &sorterThread, NULL, this->sortIncomingData_helper, this);
-    if(iret2)
+    for(size_t i = 0; i < sortWorkers.size(); i++)
     {
-        ROS_INFO("Error - pthread_create() return code: %d\n",iret1);
-        ros::shutdown();
+        iret2 = pthread_create( &sortWorkers[i]->thread, NULL, this->sortIncomingData_helper, sortWorkers[i].get());
+        if(iret2)
+        {
+            ROS_INFO("Error - pthread_create() return code: %d\n",iret2);
+            ros::shutdown();
+        }
     }
     
-    iret3 = pthread_create( &swapThread, NULL, this->syncedBufferSwap_helper, this);
-    if(iret3)
-    {
-        ROS_INFO("Error - pthread_create() return code: %d\n",iret1);
-        ros::shutdown();
-    }
+    /*Rebuild the unit tables if the sensor gets reconfigured while running*/
+    ros::Timer configTimer = nodeHandle->createTimer(ros::Duration(1.0), &DataUARTHandler::checkChirpConfig, this);
     
     ros::spin();
-
-    pthread_join(iret1, NULL);
-    ROS_INFO("DataUARTHandler Read Thread joined");
-    pthread_join(iret2, NULL);
-    ROS_INFO("DataUARTHandler Sort Thread joined");
-    pthread_join(iret3, NULL);
-    ROS_INFO("DataUARTHandler Swap Thread joined");
-    
-    pthread_mutex_destroy(&countSync_mutex);
-    pthread_mutex_destroy(&nextBufp_mutex);
-    pthread_mutex_destroy(&currentBufp_mutex);
-    pthread_cond_destroy(&countSync_max_cv);
-    pthread_cond_destroy(&read_go_cv);
-    pthread_cond_destroy(&sort_go_cv);
     
+    pthread_join(uartThread, NULL);
+    ROS_INFO("DataUARTHandler Read Thread joined");
+    for(size_t i = 0; i < sortWorkers.size(); i++)
+    {
+        pthread_join(sortWorkers[i]->thread, NULL);
+        sem_destroy(&sortWorkers[i]->frameQueue_sem);
+    }
+    ROS_INFO("DataUARTHandler Sort Threads joined");
     
+    pthread_mutex_destroy(&unitTables_mutex);
+    pthread_mutex_destroy(&freeQueue_mutex);
+    pthread_mutex_destroy(&publish_mutex);
+    pthread_cond_destroy(&publish_cond);
+
+
 }
 
 void* DataUARTHandler::readIncomingData_helper(void *context)
@@ -800,10 +1274,7 @@ void* DataUARTHandler::readIncomingData_helper(void *context)
 
 void* DataUARTHandler::sortIncomingData_helper(void *context)
 {  
-    return (static_cast<DataUARTHandler*>(context)->sortIncomingData());
-}
-
-void* DataUARTHandler::syncedBufferSwap_helper(void *context)
-{  
-    return (static_cast<DataUARTHandler*>(context)->syncedBufferSwap());
+    mmwSortContext *ctx = static_cast<mmwSortContext*>(context);
+    
+    return (ctx->handler->sortIncomingData(*ctx));
 }
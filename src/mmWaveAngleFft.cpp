@@ -0,0 +1,266 @@
+/*
+ * mmWaveAngleFft.cpp
+ *
+ * This is the implementation of mmWaveAngleFft.h
+ *
+*/
+
+#include <mmWaveAngleFft.h>
+#include <pthread.h>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+/*Range bins [begin, end) of one compute() call and the FFT scratch buffers of the thread computing them*/
+struct mmwAngleFftWorker
+{
+    mmwAngleFft *fft;
+    pthread_t thread;
+    
+    /*Posted by compute() when a job is set, or stop*/
+    sem_t start_sem;
+    
+    bool stop;
+    
+    const uint8_t *src;
+    uint32_t begin;
+    uint32_t end;
+    float *out;
+    
+    /*fftSize points each, only resized when the FFT is configured*/
+    std::vector<float> re;
+    std::vector<float> im;
+};
+
+mmwAngleFft::mmwAngleFft() : numAntennas(0), fftSize(0)
+{
+    sem_init(&done_sem, 0, 0);
+    
+    workers.push_back(new mmwAngleFftWorker);
+    workers[0]->fft = this;
+    workers[0]->stop = false;
+}
+
+mmwAngleFft::~mmwAngleFft()
+{
+    for(size_t i = 1; i < workers.size(); i++)
+    {
+        workers[i]->stop = true;
+        sem_post(&workers[i]->start_sem);
+        pthread_join(workers[i]->thread, NULL);
+        sem_destroy(&workers[i]->start_sem);
+    }
+    
+    for(size_t i = 0; i < workers.size(); i++)
+    {
+        delete workers[i];
+    }
+    
+    sem_destroy(&done_sem);
+}
+
+bool mmwAngleFft::configure(uint32_t myNumAntennas, uint32_t myFftSize)
+{
+    uint32_t log2Size = 0;
+    
+    if((myNumAntennas == 0) || (myFftSize < myNumAntennas) || (myFftSize & (myFftSize - 1)))
+    {
+        return false;
+    }
+    
+    while((1u << log2Size) < myFftSize)
+    {
+        log2Size++;
+    }
+    
+    numAntennas = myNumAntennas;
+    fftSize = myFftSize;
+    
+    /*Hann window without its zero end points, so no antenna is thrown away*/
+    window.resize(numAntennas);
+    for(uint32_t n = 0; n < numAntennas; n++)
+    {
+        window[n] = 0.5f - 0.5f * cosf(2 * M_PI * (n + 1) / (numAntennas + 1));
+    }
+    
+    twiddleRe.resize(fftSize / 2);
+    twiddleIm.resize(fftSize / 2);
+    for(uint32_t k = 0; k < fftSize / 2; k++)
+    {
+        twiddleRe[k] = cos(2 * M_PI * k / fftSize);
+        twiddleIm[k] = -sin(2 * M_PI * k / fftSize);
+    }
+    
+    /*Only the antennas are non-zero, the zero padding is cleared once per row*/
+    bitReverse.resize(numAntennas);
+    for(uint32_t n = 0; n < numAntennas; n++)
+    {
+        uint32_t reversed = 0;
+        
+        for(uint32_t b = 0; b < log2Size; b++)
+        {
+            reversed |= ((n >> b) & 1) << (log2Size - 1 - b);
+        }
+        bitReverse[n] = reversed;
+    }
+    
+    for(size_t i = 0; i < workers.size(); i++)
+    {
+        workers[i]->re.resize(fftSize);
+        workers[i]->im.resize(fftSize);
+    }
+    
+    return true;
+}
+
+uint32_t mmwAngleFft::getNumAntennas(void) const
+{
+    return numAntennas;
+}
+
+uint32_t mmwAngleFft::getFftSize(void) const
+{
+    return fftSize;
+}
+
+void mmwAngleFft::computeRows(mmwAngleFftWorker &worker) const
+{
+    std::vector<float> &re = worker.re;
+    std::vector<float> &im = worker.im;
+    int16_t sample[2];
+    
+    for(uint32_t r = worker.begin; r < worker.end; r++)
+    {
+        const uint8_t *row = worker.src + r * numAntennas * sizeof(sample);
+        float *outRow = worker.out + r * fftSize;
+        
+        std::fill(re.begin(), re.end(), 0.0f);
+        std::fill(im.begin(), im.end(), 0.0f);
+        
+        // Samples are cmplx16ImRe_t, the imaginary part first
+        for(uint32_t n = 0; n < numAntennas; n++)
+        {
+            memcpy(sample, row + n * sizeof(sample), sizeof(sample));
+            re[bitReverse[n]] = sample[1] * window[n];
+            im[bitReverse[n]] = sample[0] * window[n];
+        }
+        
+        /*Iterative radix-2 decimation in time*/
+        for(uint32_t len = 2; len <= fftSize; len <<= 1)
+        {
+            uint32_t half = len / 2;
+            uint32_t step = fftSize / len;
+            
+            for(uint32_t i = 0; i < fftSize; i += len)
+            {
+                for(uint32_t j = 0; j < half; j++)
+                {
+                    uint32_t k = i + j;
+                    uint32_t m = k + half;
+                    float wr = twiddleRe[j * step];
+                    float wi = twiddleIm[j * step];
+                    float tr = wr * re[m] - wi * im[m];
+                    float ti = wr * im[m] + wi * re[m];
+                    
+                    re[m] = re[k] - tr;
+                    im[m] = im[k] - ti;
+                    re[k] += tr;
+                    im[k] += ti;
+                }
+            }
+        }
+        
+        // fftshift, broadside ends up in column fftSize/2
+        for(uint32_t k = 0; k < fftSize; k++)
+        {
+            outRow[(k + fftSize / 2) & (fftSize - 1)] = 10 * log10f(re[k] * re[k] + im[k] * im[k] + 1);
+        }
+    }
+}
+
+bool mmwAngleFft::startWorker(void)
+{
+    mmwAngleFftWorker *worker = new mmwAngleFftWorker;
+    
+    worker->fft = this;
+    worker->stop = false;
+    worker->re.resize(fftSize);
+    worker->im.resize(fftSize);
+    sem_init(&worker->start_sem, 0, 0);
+    
+    if(pthread_create(&worker->thread, NULL, worker_helper, worker))
+    {
+        sem_destroy(&worker->start_sem);
+        delete worker;
+        return false;
+    }
+    
+    workers.push_back(worker);
+    
+    return true;
+}
+
+void *mmwAngleFft::worker_helper(void *context)
+{
+    mmwAngleFftWorker *worker = static_cast<mmwAngleFftWorker*>(context);
+    
+    while(true)
+    {
+        while(sem_wait(&worker->start_sem) != 0)
+        {
+            // interrupted by a signal
+        }
+        
+        if(worker->stop)
+        {
+            break;
+        }
+        
+        worker->fft->computeRows(*worker);
+        sem_post(&worker->fft->done_sem);
+    }
+    
+    return NULL;
+}
+
+void mmwAngleFft::compute(const uint8_t *src, uint32_t numRangeBins, float *out, int numThreads)
+{
+    uint32_t numJobs;
+    
+    if(fftSize == 0)
+    {
+        return;
+    }
+    
+    numJobs = std::max(1u, std::min((uint32_t) std::max(numThreads, 1), numRangeBins));
+    
+    /*Threads are only started when more are asked for than ever before, if one cannot be started the others share its rows*/
+    while((workers.size() < numJobs) && startWorker())
+    {
+    }
+    numJobs = std::min(numJobs, (uint32_t) workers.size());
+    
+    for(uint32_t i = 0; i < numJobs; i++)
+    {
+        workers[i]->src = src;
+        workers[i]->begin = (uint64_t) numRangeBins * i / numJobs;
+        workers[i]->end = (uint64_t) numRangeBins * (i + 1) / numJobs;
+        workers[i]->out = out;
+    }
+    
+    /*The calling thread takes the first share while the workers run theirs*/
+    for(uint32_t i = 1; i < numJobs; i++)
+    {
+        sem_post(&workers[i]->start_sem);
+    }
+    
+    computeRows(*workers[0]);
+    
+    for(uint32_t i = 1; i < numJobs; i++)
+    {
+        while(sem_wait(&done_sem) != 0)
+        {
+            // interrupted by a signal
+        }
+    }
+}
@@ -0,0 +1,731 @@
+/*
+ * mmWaveByteSource.cpp
+ *
+ * This is the implementation of mmWaveByteSource.h
+ * Every source hands back whatever is pending in a single read call so the
+ * read thread never goes back to the kernel once per byte.
+ *
+*/
+
+#include <mmWaveByteSource.h>
+#include "ros/ros.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/serial.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+/*Time the read functions wait for data before returning 0*/
+#define READ_TIMEOUT_MS 100
+
+/*Delay before the first attempt to reconnect a dropped TCP connection, doubled after every failed attempt up to the maximum*/
+#define RECONNECT_MIN_MS 100
+#define RECONNECT_MAX_MS 5000
+
+/*Time a TCP connection attempt may take before it counts as failed (the kernel would retry the SYN for minutes)*/
+#define CONNECT_TIMEOUT_MS 2000
+
+static uint64_t monotonicMs(void)
+{
+    struct timespec ts;
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+SerialByteSource::SerialByteSource(const std::string &port, int baudRate) : mySerialObject("", baudRate, serial::Timeout::simpleTimeout(READ_TIMEOUT_MS))
+{
+    mySerialObject.setPort(port);
+}
+
+void SerialByteSource::open(void)
+{
+    mySerialObject.open();
+}
+
+bool SerialByteSource::isOpen(void)
+{
+    return mySerialObject.isOpen();
+}
+
+size_t SerialByteSource::read(uint8_t *buf, size_t maxLen)
+{
+    size_t toRead;
+    
+    /*Block (up to the port timeout) until data is pending, then take all of it in a single read*/
+    toRead = mySerialObject.available();
+    if(toRead == 0)
+    {
+        mySerialObject.waitReadable();
+        toRead = mySerialObject.available();
+        if(toRead == 0)
+        {
+            return 0;
+        }
+    }
+    
+    if(toRead > maxLen)
+    {
+        toRead = maxLen;
+    }
+    
+    return mySerialObject.read(buf, toRead);
+}
+
+void SerialByteSource::close(void)
+{
+    mySerialObject.close();
+}
+
+FdByteSource::FdByteSource(const std::string &name) : sourceName(name), fd(-1), epollFd(-1)
+{
+}
+
+FdByteSource::~FdByteSource()
+{
+    close();
+}
+
+void FdByteSource::watchFd(void)
+{
+    struct epoll_event ev;
+    int flags;
+    
+    flags = fcntl(fd, F_GETFL, 0);
+    if((flags < 0) || (fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0))
+    {
+        fail("fcntl " + sourceName);
+    }
+    
+    epollFd = epoll_create1(0);
+    if(epollFd < 0)
+    {
+        fail("epoll_create1");
+    }
+    
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if(epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+        fail("epoll_ctl");
+    }
+}
+
+void FdByteSource::fail(const std::string &what)
+{
+    int err = errno;
+    
+    close();
+    throw std::runtime_error(what + ": " + strerror(err));
+}
+
+bool FdByteSource::isOpen(void)
+{
+    return (fd >= 0);
+}
+
+size_t FdByteSource::read(uint8_t *buf, size_t maxLen)
+{
+    struct epoll_event ev;
+    ssize_t n;
+    
+    /*Sleep until the source has data (or the timeout passes), then take everything pending in one read*/
+    if(epoll_wait(epollFd, &ev, 1, READ_TIMEOUT_MS) <= 0)
+    {
+        return 0;
+    }
+    
+    /*Hung up with nothing left to read (no writer on the other side), wait like a timeout instead of spinning on epoll*/
+    if((ev.events & EPOLLHUP) && !(ev.events & EPOLLIN))
+    {
+        usleep(READ_TIMEOUT_MS * 1000);
+        return 0;
+    }
+    
+    n = ::read(fd, buf, maxLen);
+    if(n < 0)
+    {
+        if((errno == EAGAIN) || (errno == EINTR))
+        {
+            return 0;
+        }
+        
+        /*A tty reports a hang up as EIO, the writer may come back*/
+        if(errno == EIO)
+        {
+            usleep(READ_TIMEOUT_MS * 1000);
+            return 0;
+        }
+        throw std::runtime_error("read " + sourceName + ": " + strerror(errno));
+    }
+    
+    return n;
+}
+
+void FdByteSource::close(void)
+{
+    if(epollFd >= 0)
+    {
+        ::close(epollFd);
+        epollFd = -1;
+    }
+    
+    if(fd >= 0)
+    {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+TermiosByteSource::TermiosByteSource(const std::string &port, int baudRate) : FdByteSource(port), baudRate(baudRate)
+{
+}
+
+void TermiosByteSource::open(void)
+{
+    struct termios tio;
+    speed_t speed;
+    
+    switch(baudRate)
+    {
+    case 115200:  speed = B115200;  break;
+    case 230400:  speed = B230400;  break;
+    case 460800:  speed = B460800;  break;
+    case 921600:  speed = B921600;  break;
+    case 1000000: speed = B1000000; break;
+    case 1500000: speed = B1500000; break;
+    case 2000000: speed = B2000000; break;
+    case 3000000: speed = B3000000; break;
+    default:
+        throw std::runtime_error("TermiosByteSource: unsupported baud rate " + std::to_string(baudRate));
+    }
+    
+    fd = ::open(sourceName.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if(fd < 0)
+    {
+        fail("open " + sourceName);
+    }
+    
+    /*Raw 8N1, reads never block in the kernel (VMIN = VTIME = 0), epoll does the waiting*/
+    if(tcgetattr(fd, &tio) < 0)
+    {
+        fail("tcgetattr " + sourceName);
+    }
+    cfmakeraw(&tio);
+    tio.c_cflag |= (CLOCAL | CREAD);
+    tio.c_cflag &= ~(CSTOPB | CRTSCTS);
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    if(tcsetattr(fd, TCSANOW, &tio) < 0)
+    {
+        fail("tcsetattr " + sourceName);
+    }
+    tcflush(fd, TCIFLUSH);
+    
+    setLowLatency();
+    
+    watchFd();
+}
+
+void TermiosByteSource::setLowLatency(void)
+{
+    struct serial_struct serinfo;
+    std::string devName;
+    std::string latencyTimerPath;
+    FILE *latencyTimer;
+    
+    /*Ask the tty driver to push received bytes to us immediately instead of batching them*/
+    if((ioctl(fd, TIOCGSERIAL, &serinfo) == 0))
+    {
+        serinfo.flags |= ASYNC_LOW_LATENCY;
+        if(ioctl(fd, TIOCSSERIAL, &serinfo) == 0)
+        {
+            ROS_INFO("TermiosByteSource: ASYNC_LOW_LATENCY set on %s", sourceName.c_str());
+        }
+        else
+        {
+            ROS_INFO("TermiosByteSource: Could not set ASYNC_LOW_LATENCY on %s: %s", sourceName.c_str(), strerror(errno));
+        }
+    }
+    
+    /*FTDI adapters hold bytes for latency_timer ms (16 by default) before sending them over USB, use the minimum*/
+    devName = sourceName.substr(sourceName.find_last_of('/') + 1);
+    latencyTimerPath = "/sys/bus/usb-serial/devices/" + devName + "/latency_timer";
+    latencyTimer = fopen(latencyTimerPath.c_str(), "w");
+    if(latencyTimer != NULL)
+    {
+        fputs("1", latencyTimer);
+        fclose(latencyTimer);
+        ROS_INFO("TermiosByteSource: latency_timer set to 1 ms on %s", sourceName.c_str());
+    }
+}
+
+FileByteSource::FileByteSource(const std::string &path) : path(path), fd(-1), endReported(false)
+{
+}
+
+FileByteSource::~FileByteSource()
+{
+    close();
+}
+
+void FileByteSource::open(void)
+{
+    fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+        throw std::runtime_error("open " + path + ": " + strerror(errno));
+    }
+    endReported = false;
+}
+
+bool FileByteSource::isOpen(void)
+{
+    return (fd >= 0);
+}
+
+size_t FileByteSource::read(uint8_t *buf, size_t maxLen)
+{
+    ssize_t n;
+    
+    n = ::read(fd, buf, maxLen);
+    if(n < 0)
+    {
+        if(errno == EINTR)
+        {
+            return 0;
+        }
+        throw std::runtime_error("read " + path + ": " + strerror(errno));
+    }
+    
+    /*End of the capture, idle like a port with no data instead of spinning*/
+    if(n == 0)
+    {
+        if(!endReported)
+        {
+            ROS_INFO("FileByteSource: Reached end of %s", path.c_str());
+            endReported = true;
+        }
+        usleep(READ_TIMEOUT_MS * 1000);
+    }
+    
+    return n;
+}
+
+void FileByteSource::close(void)
+{
+    if(fd >= 0)
+    {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+/*Splits "host:port" (or just "port") and resolves it with getaddrinfo*/
+static struct addrinfo *resolveAddress(const std::string &address, int sockType, bool passive)
+{
+    struct addrinfo hints;
+    struct addrinfo *result = NULL;
+    std::string host;
+    std::string port;
+    size_t colon;
+    int err;
+    
+    colon = address.find_last_of(':');
+    if(colon == std::string::npos)
+    {
+        port = address;
+    }
+    else
+    {
+        host = address.substr(0, colon);
+        port = address.substr(colon + 1);
+    }
+    
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = sockType;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+    
+    err = getaddrinfo(host.empty() ? NULL : host.c_str(), port.c_str(), &hints, &result);
+    if(err != 0)
+    {
+        throw std::runtime_error("getaddrinfo " + address + ": " + gai_strerror(err));
+    }
+    
+    return result;
+}
+
+TcpByteSource::TcpByteSource(const std::string &address) : FdByteSource(address), retryDelayMs(RECONNECT_MIN_MS), nextRetryMs(0),
+                                                             connecting(false), connectDeadlineMs(0)
+{
+}
+
+void TcpByteSource::open(void)
+{
+    /*Wait for the connection here, the read thread is only started on an open source*/
+    startConnect();
+    while(!finishConnect(READ_TIMEOUT_MS))
+    {
+        if(monotonicMs() >= connectDeadlineMs)
+        {
+            close();
+            throw std::runtime_error("TcpByteSource: connecting to " + sourceName + " timed out");
+        }
+    }
+}
+
+void TcpByteSource::close(void)
+{
+    FdByteSource::close();
+    connecting = false;
+}
+
+void TcpByteSource::startConnect(void)
+{
+    struct addrinfo *addrs = resolveAddress(sourceName, SOCK_STREAM, false);
+    struct addrinfo *ai;
+    struct epoll_event ev;
+    
+    /*Non-blocking, connect() returns at once and epoll reports (as writable) when the handshake is done*/
+    for(ai = addrs; ai != NULL; ai = ai->ai_next)
+    {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK, ai->ai_protocol);
+        if(fd < 0)
+        {
+            continue;
+        }
+        if(connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+        {
+            connecting = false;
+            break;
+        }
+        if(errno == EINPROGRESS)
+        {
+            connecting = true;
+            break;
+        }
+        ::close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addrs);
+    
+    if(fd < 0)
+    {
+        throw std::runtime_error("TcpByteSource: could not connect to " + sourceName);
+    }
+    
+    watchFd();
+    connectDeadlineMs = monotonicMs() + CONNECT_TIMEOUT_MS;
+    
+    if(connecting)
+    {
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLOUT;
+        ev.data.fd = fd;
+        if(epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev) < 0)
+        {
+            fail("epoll_ctl");
+        }
+    }
+    else
+    {
+        connected();
+    }
+}
+
+bool TcpByteSource::finishConnect(int timeoutMs)
+{
+    struct epoll_event ev;
+    int err = 0;
+    socklen_t errLen = sizeof(err);
+    
+    if(!connecting)
+    {
+        return true;
+    }
+    
+    if(epoll_wait(epollFd, &ev, 1, timeoutMs) <= 0)
+    {
+        return false;
+    }
+    
+    if(getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &errLen) < 0)
+    {
+        fail("getsockopt " + sourceName);
+    }
+    if(err != 0)
+    {
+        errno = err;
+        fail("connect " + sourceName);
+    }
+    
+    /*Wait for data from now on*/
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if(epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev) < 0)
+    {
+        fail("epoll_ctl");
+    }
+    connecting = false;
+    connected();
+    
+    return true;
+}
+
+void TcpByteSource::connected(void)
+{
+    int one = 1;
+    
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+size_t TcpByteSource::read(uint8_t *buf, size_t maxLen)
+{
+    struct epoll_event ev;
+    ssize_t n;
+    
+    if((fd < 0) || connecting)
+    {
+        reconnect();
+        return 0;
+    }
+    
+    if(epoll_wait(epollFd, &ev, 1, READ_TIMEOUT_MS) <= 0)
+    {
+        return 0;
+    }
+    
+    n = ::read(fd, buf, maxLen);
+    if(n < 0)
+    {
+        if((errno == EAGAIN) || (errno == EINTR))
+        {
+            return 0;
+        }
+        ROS_WARN("TcpByteSource: read %s: %s, reconnecting", sourceName.c_str(), strerror(errno));
+        dropConnection();
+        return 0;
+    }
+    
+    /*Readable with no data means the bridge closed the connection*/
+    if(n == 0)
+    {
+        ROS_WARN("TcpByteSource: Connection to %s closed, reconnecting", sourceName.c_str());
+        dropConnection();
+        return 0;
+    }
+    
+    return n;
+}
+
+void TcpByteSource::dropConnection(void)
+{
+    close();
+    retryDelayMs = RECONNECT_MIN_MS;
+    nextRetryMs = monotonicMs();
+}
+
+void TcpByteSource::reconnect(void)
+{
+    uint64_t now = monotonicMs();
+    
+    /*Not due yet, wait at most one read timeout so the caller still gets to check for shutdown*/
+    if((fd < 0) && (now < nextRetryMs))
+    {
+        usleep(std::min<uint64_t>(nextRetryMs - now, READ_TIMEOUT_MS) * 1000);
+        return;
+    }
+    
+    /*Start an attempt, or wait one read timeout for the pending one, never blocking in connect()*/
+    try
+    {
+        if(fd < 0)
+        {
+            startConnect();
+        }
+        if(!finishConnect(READ_TIMEOUT_MS))
+        {
+            if(monotonicMs() < connectDeadlineMs)
+            {
+                return;
+            }
+            close();
+            throw std::runtime_error("connecting to " + sourceName + " timed out");
+        }
+        ROS_INFO("TcpByteSource: Reconnected to %s", sourceName.c_str());
+        retryDelayMs = RECONNECT_MIN_MS;
+    } catch (std::exception &e) {
+        ROS_WARN("TcpByteSource: %s, retrying in %u ms", e.what(), retryDelayMs);
+        nextRetryMs = monotonicMs() + retryDelayMs;
+        retryDelayMs = std::min(retryDelayMs * 2, (unsigned int) RECONNECT_MAX_MS);
+    }
+}
+
+UdpByteSource::UdpByteSource(const std::string &address) : FdByteSource(address)
+{
+}
+
+void UdpByteSource::open(void)
+{
+    struct addrinfo *addrs = resolveAddress(sourceName, SOCK_DGRAM, true);
+    struct addrinfo *ai;
+    int rcvBuf = 1 << 20;
+    
+    for(ai = addrs; ai != NULL; ai = ai->ai_next)
+    {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if(fd < 0)
+        {
+            continue;
+        }
+        if(bind(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+        {
+            break;
+        }
+        ::close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addrs);
+    
+    if(fd < 0)
+    {
+        throw std::runtime_error("UdpByteSource: could not bind to " + sourceName);
+    }
+    
+    /*Room for a few frames of datagrams in case the read thread is descheduled*/
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvBuf, sizeof(rcvBuf));
+    
+    watchFd();
+}
+
+PtyByteSource::PtyByteSource(const std::string &linkPath) : FdByteSource(linkPath), slaveFd(-1), linkCreated(false)
+{
+}
+
+PtyByteSource::~PtyByteSource()
+{
+    close();
+}
+
+void PtyByteSource::open(void)
+{
+    struct termios tio;
+    struct stat st;
+    
+    fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if(fd < 0)
+    {
+        fail("posix_openpt");
+    }
+    if((grantpt(fd) < 0) || (unlockpt(fd) < 0))
+    {
+        fail("grantpt/unlockpt");
+    }
+    slave = ptsname(fd);
+    
+    /*Keep the slave open ourselves, otherwise the master hangs up (reads fail with EIO) as soon as the first writer closes it*/
+    slaveFd = ::open(slave.c_str(), O_RDWR | O_NOCTTY);
+    if(slaveFd < 0)
+    {
+        fail("open " + slave);
+    }
+    
+    /*Raw mode so the stream is passed through byte for byte*/
+    if(tcgetattr(fd, &tio) == 0)
+    {
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    
+    /*Only a stale symlink (from an earlier run) is replaced, never a device node or file someone pointed data_port at*/
+    if(!sourceName.empty())
+    {
+        if(lstat(sourceName.c_str(), &st) == 0)
+        {
+            if(!S_ISLNK(st.st_mode))
+            {
+                close();
+                throw std::runtime_error(sourceName + " exists and is not a symlink, refusing to replace it (set data_port to a free link path)");
+            }
+            unlink(sourceName.c_str());
+        }
+        if(symlink(slave.c_str(), sourceName.c_str()) < 0)
+        {
+            fail("symlink " + sourceName);
+        }
+        linkCreated = true;
+    }
+    
+    ROS_INFO("PtyByteSource: Write the data stream to %s%s%s", slave.c_str(), sourceName.empty() ? "" : " or ", sourceName.c_str());
+    
+    watchFd();
+}
+
+void PtyByteSource::close(void)
+{
+    if(linkCreated)
+    {
+        unlink(sourceName.c_str());
+        linkCreated = false;
+    }
+    
+    if(slaveFd >= 0)
+    {
+        ::close(slaveFd);
+        slaveFd = -1;
+    }
+    
+    FdByteSource::close();
+}
+
+const std::string &PtyByteSource::slaveName(void) const
+{
+    return slave;
+}
+
+ByteSource *createByteSource(const std::string &type, const std::string &port, int baudRate)
+{
+    if(type == "serial")
+    {
+        return new SerialByteSource(port, baudRate);
+    }
+    else if(type == "termios")
+    {
+        return new TermiosByteSource(port, baudRate);
+    }
+    else if(type == "file")
+    {
+        return new FileByteSource(port);
+    }
+    else if(type == "tcp")
+    {
+        return new TcpByteSource(port);
+    }
+    else if(type == "udp")
+    {
+        return new UdpByteSource(port);
+    }
+    else if(type == "pty")
+    {
+        return new PtyByteSource(port);
+    }
+    
+    return NULL;
+}
@@ -52,14 +52,27 @@ void mmWaveDataHdl::onInit()
    ros::NodeHandle private_nh = getPrivateNodeHandle();
    
    std::string mySerialPort;
+   std::string myDataSource;
    int myBaudRate;
    int myMaxAllowedElevationAngleDeg;
    int myMaxAllowedAzimuthAngleDeg;
+   int myReadBlockSize;
+   int mySortThreads;
+   int myAzimuthFftSize;
+   int myAzimuthFftThreads;
+   float myMinRange, myMaxRange;
+   float myMinDoppler, myMaxDoppler;
+   float myMinIntensity, myMaxIntensity;
    
    private_nh.getParam("/mmWave_Manager/data_port", mySerialPort);
    
    private_nh.getParam("/mmWave_Manager/data_rate", myBaudRate);
    
+   if (!(private_nh.getParam("/mmWave_Manager/data_source", myDataSource)))
+   {
+      myDataSource = "serial";  // Use the serial library if none specified
+   }
+
    if (!(private_nh.getParam("/mmWave_Manager/max_allowed_elevation_angle_deg", myMaxAllowedElevationAngleDeg)))
    {
       myMaxAllowedElevationAngleDeg = 90;  // Use max angle if none specified
@@ -70,16 +83,80 @@ void mmWaveDataHdl::onInit()
       myMaxAllowedAzimuthAngleDeg = 90;  // Use max angle if none specified
    }
 
+   if (!(private_nh.getParam("/mmWave_Manager/data_read_block_size", myReadBlockSize)))
+   {
+      myReadBlockSize = 4096;  // Use default block size if none specified
+   }
+
+   if (!(private_nh.getParam("/mmWave_Manager/sort_threads", mySortThreads)))
+   {
+      mySortThreads = 1;  // Decode on a single thread if none specified
+   }
+
+   if (!(private_nh.getParam("/mmWave_Manager/azimuth_fft_size", myAzimuthFftSize)))
+   {
+      myAzimuthFftSize = 64;  // Use 64 angle bins if none specified
+   }
+
+   if (!(private_nh.getParam("/mmWave_Manager/azimuth_fft_threads", myAzimuthFftThreads)))
+   {
+      myAzimuthFftThreads = 1;  // Compute the azimuth heatmap on the sort thread if none specified
+   }
+
+   // Range (m), doppler (m/s) and intensity (dB) gates, each bound is optional and unlimited if not specified
+   if (!(private_nh.getParam("/mmWave_Manager/min_range", myMinRange)))
+   {
+      myMinRange = -INFINITY;
+   }
+
+   if (!(private_nh.getParam("/mmWave_Manager/max_range", myMaxRange)))
+   {
+      myMaxRange = INFINITY;
+   }
+
+   if (!(private_nh.getParam("/mmWave_Manager/min_doppler", myMinDoppler)))
+   {
+      myMinDoppler = -INFINITY;
+   }
+
+   if (!(private_nh.getParam("/mmWave_Manager/max_doppler", myMaxDoppler)))
+   {
+      myMaxDoppler = INFINITY;
+   }
+
+   if (!(private_nh.getParam("/mmWave_Manager/min_intensity", myMinIntensity)))
+   {
+      myMinIntensity = -INFINITY;
+   }
+
+   if (!(private_nh.getParam("/mmWave_Manager/max_intensity", myMaxIntensity)))
+   {
+      myMaxIntensity = INFINITY;
+   }
+
    ROS_INFO("mmWaveDataHdl: data_port = %s", mySerialPort.c_str());
    ROS_INFO("mmWaveDataHdl: data_rate = %d", myBaudRate);
+   ROS_INFO("mmWaveDataHdl: data_source = %s", myDataSource.c_str());
    ROS_INFO("mmWaveDataHdl: max_allowed_elevation_angle_deg = %d", myMaxAllowedElevationAngleDeg);
    ROS_INFO("mmWaveDataHdl: max_allowed_azimuth_angle_deg = %d", myMaxAllowedAzimuthAngleDeg);
+   ROS_INFO("mmWaveDataHdl: data_read_block_size = %d", myReadBlockSize);
+   ROS_INFO("mmWaveDataHdl: sort_threads = %d", mySortThreads);
+   ROS_INFO("mmWaveDataHdl: azimuth_fft_size = %d azimuth_fft_threads = %d", myAzimuthFftSize, myAzimuthFftThreads);
+   ROS_INFO("mmWaveDataHdl: range = [%f, %f] doppler = [%f, %f] intensity = [%f, %f]", myMinRange, myMaxRange, myMinDoppler, myMaxDoppler, myMinIntensity, myMaxIntensity);
    
    DataUARTHandler DataHandler(&private_nh);
    DataHandler.setUARTPort( (char*) mySerialPort.c_str() );
    DataHandler.setBaudRate( myBaudRate );
+   DataHandler.setDataSource( myDataSource );
    DataHandler.setMaxAllowedElevationAngleDeg( myMaxAllowedElevationAngleDeg );
    DataHandler.setMaxAllowedAzimuthAngleDeg( myMaxAllowedAzimuthAngleDeg );
+   DataHandler.setReadBlockSize( myReadBlockSize );
+   DataHandler.setSortThreads( mySortThreads );
+   DataHandler.setAzimuthFftSize( myAzimuthFftSize );
+   DataHandler.setAzimuthFftThreads( myAzimuthFftThreads );
+   DataHandler.setRangeLimits( myMinRange, myMaxRange );
+   DataHandler.setDopplerLimits( myMinDoppler, myMaxDoppler );
+   DataHandler.setIntensityLimits( myMinIntensity, myMaxIntensity );
    DataHandler.start();
    
    NODELET_DEBUG("mmWaveDataHdl: Finished onInit function");
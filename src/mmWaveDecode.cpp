@@ -0,0 +1,411 @@
+/*
+ * mmWaveDecode.cpp
+ *
+ * This is the implementation of mmWaveDecode.h
+ *
+*/
+
+#include <mmWaveDecode.h>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+/*Reads the little-endian uint16 at p, the payload is only byte aligned in the packet (compiles to a plain unaligned load)*/
+static inline uint16_t loadU16(const uint8_t *p)
+{
+    uint16_t value;
+    
+    memcpy(&value, p, sizeof(value));
+    
+    return value;
+}
+
+/*Q9 log2 magnitude -> 20*log10(magnitude)*/
+static const float LOG_MAG_TO_DB = 20.0f * 0.30103f / 512.0f;
+
+/*Deinterleaves count packed objects into one array per field. The arrays never overlap each other or the packet,
+  saying so with __restrict keeps run-time alias checks out of the loop so it can be vectorized where the target has interleaved loads*/
+static void deinterleaveDetectedObjs(const uint8_t * __restrict src, size_t count,
+                                     uint16_t * __restrict rangeIdx, uint16_t * __restrict dopplerIdx, uint16_t * __restrict peakVal,
+                                     int16_t * __restrict x, int16_t * __restrict y, int16_t * __restrict z)
+{
+    for(size_t i = 0; i < count; i++)
+    {
+        const uint8_t *obj = src + i * sizeof(MmwDemo_DetectedObj);
+        
+        rangeIdx[i]   = loadU16(obj + offsetof(MmwDemo_DetectedObj, rangeIdx));
+        dopplerIdx[i] = loadU16(obj + offsetof(MmwDemo_DetectedObj, dopplerIdx));
+        peakVal[i]    = loadU16(obj + offsetof(MmwDemo_DetectedObj, peakVal));
+        x[i]          = (int16_t) loadU16(obj + offsetof(MmwDemo_DetectedObj, x));
+        y[i]          = (int16_t) loadU16(obj + offsetof(MmwDemo_DetectedObj, y));
+        z[i]          = (int16_t) loadU16(obj + offsetof(MmwDemo_DetectedObj, z));
+    }
+}
+
+void decodeDetectedObjs(const uint8_t *src, size_t count, mmwDetectedObjs &objs)
+{
+    /*resize() does not allocate once the arrays have grown to the largest packet seen*/
+    objs.rangeIdx.resize(count);
+    objs.dopplerIdx.resize(count);
+    objs.peakVal.resize(count);
+    objs.x.resize(count);
+    objs.y.resize(count);
+    objs.z.resize(count);
+    
+    if(count == 0)
+    {
+        return;
+    }
+    
+    deinterleaveDetectedObjs(src, count, &objs.rangeIdx[0], &objs.dopplerIdx[0], &objs.peakVal[0],
+                             &objs.x[0], &objs.y[0], &objs.z[0]);
+}
+
+/*Number of values a uint16 field can take, the size of every unit table*/
+#define UINT16_VALUES 65536
+
+void buildUnitTables(const mmwChirpConfig &config, mmwUnitTables &tables)
+{
+    int dopplerIdx;
+    
+    tables.config = config;
+    tables.intensityDb.resize(UINT16_VALUES);
+    tables.rangeMeters.resize(UINT16_VALUES);
+    tables.dopplerMps.resize(UINT16_VALUES);
+    
+    for(int i = 0; i < UINT16_VALUES; i++)
+    {
+        // Convert intensity to dB
+        tables.intensityDb[i] = 10 * log10(i + 1);
+        
+        // Convert rangeIdx to meters
+        tables.rangeMeters[i] = i * config.rangeIdxToMeters;
+        
+        // Convert dopplerIdx to meters per second, indices past the middle bin are negative velocities
+        dopplerIdx = (int16_t) i;
+        if(dopplerIdx > config.numDopplerBins / 2 - 1)
+        {
+            dopplerIdx -= config.numDopplerBins;
+        }
+        tables.dopplerMps[i] = dopplerIdx * config.dopplerResolutionToMps;
+    }
+}
+
+/*Converts x/y/z of points [begin, end) one at a time, the fallback and the tail of the vector loop*/
+static void convertDetectedObjsScalar(const mmwDetectedObjs &objs, float xyzScale, mmwDetectedPoints &points,
+                                      size_t begin, size_t end)
+{
+    for(size_t i = begin; i < end; i++)
+    {
+        // Map mmWave sensor coordinates to ROS coordinate system (X forward = sensor Y, Y left = sensor -X, Z up = sensor Z)
+        points.x[i] = objs.y[i] * xyzScale;
+        points.y[i] = objs.x[i] * -xyzScale;
+        points.z[i] = objs.z[i] * xyzScale;
+    }
+}
+
+#if defined(__AVX2__)
+
+#include <immintrin.h>
+
+#define CONVERT_LANES 8
+#define CONVERT_ISA "avx2"
+
+typedef __m256 vfloat;
+
+static inline vfloat vLoadS16(const int16_t *p)   { return _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) p))); }
+static inline vfloat vLoadU16(const uint8_t *p)   { return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) p))); }
+static inline vfloat vSplat(float f)              { return _mm256_set1_ps(f); }
+static inline vfloat vMul(vfloat a, vfloat b)     { return _mm256_mul_ps(a, b); }
+static inline void vStore(float *p, vfloat a)     { _mm256_storeu_ps(p, a); }
+
+typedef __m256 vmask;
+
+static inline vfloat vLoad(const float *p)        { return _mm256_loadu_ps(p); }
+static inline vfloat vAdd(vfloat a, vfloat b)     { return _mm256_add_ps(a, b); }
+static inline vfloat vAbs(vfloat a)               { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+static inline vmask vLt(vfloat a, vfloat b)       { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+static inline vmask vLe(vfloat a, vfloat b)       { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+static inline vmask vNe(vfloat a, vfloat b)       { return _mm256_cmp_ps(a, b, _CMP_NEQ_OQ); }
+static inline vmask vAnd(vmask a, vmask b)        { return _mm256_and_ps(a, b); }
+static inline void vStoreMask(uint32_t *p, vmask a) { _mm256_storeu_ps((float *) p, a); }
+
+#elif defined(__SSE2__)
+
+#include <emmintrin.h>
+
+#define CONVERT_LANES 4
+#define CONVERT_ISA "sse2"
+
+typedef __m128 vfloat;
+
+static inline vfloat vLoadS16(const int16_t *p)
+{
+    __m128i v = _mm_loadl_epi64((const __m128i *) p);
+    
+    return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+}
+static inline vfloat vLoadU16(const uint8_t *p)
+{
+    __m128i v = _mm_loadl_epi64((const __m128i *) p);
+    
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, _mm_setzero_si128()));
+}
+static inline vfloat vSplat(float f)              { return _mm_set1_ps(f); }
+static inline vfloat vMul(vfloat a, vfloat b)     { return _mm_mul_ps(a, b); }
+static inline void vStore(float *p, vfloat a)     { _mm_storeu_ps(p, a); }
+
+typedef __m128 vmask;
+
+static inline vfloat vLoad(const float *p)        { return _mm_loadu_ps(p); }
+static inline vfloat vAdd(vfloat a, vfloat b)     { return _mm_add_ps(a, b); }
+static inline vfloat vAbs(vfloat a)               { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+static inline vmask vLt(vfloat a, vfloat b)       { return _mm_cmplt_ps(a, b); }
+static inline vmask vLe(vfloat a, vfloat b)       { return _mm_cmple_ps(a, b); }
+static inline vmask vNe(vfloat a, vfloat b)       { return _mm_cmpneq_ps(a, b); }
+static inline vmask vAnd(vmask a, vmask b)        { return _mm_and_ps(a, b); }
+static inline void vStoreMask(uint32_t *p, vmask a) { _mm_storeu_ps((float *) p, a); }
+
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+#include <arm_neon.h>
+
+#define CONVERT_LANES 4
+#define CONVERT_ISA "neon"
+
+typedef float32x4_t vfloat;
+
+static inline vfloat vLoadS16(const int16_t *p)   { return vcvtq_f32_s32(vmovl_s16(vld1_s16(p))); }
+static inline vfloat vLoadU16(const uint8_t *p)   { return vcvtq_f32_u32(vmovl_u16(vreinterpret_u16_u8(vld1_u8(p)))); }
+static inline vfloat vSplat(float f)              { return vdupq_n_f32(f); }
+static inline vfloat vMul(vfloat a, vfloat b)     { return vmulq_f32(a, b); }
+static inline void vStore(float *p, vfloat a)     { vst1q_f32(p, a); }
+
+typedef uint32x4_t vmask;
+
+static inline vfloat vLoad(const float *p)        { return vld1q_f32(p); }
+static inline vfloat vAdd(vfloat a, vfloat b)     { return vaddq_f32(a, b); }
+static inline vfloat vAbs(vfloat a)               { return vabsq_f32(a); }
+static inline vmask vLt(vfloat a, vfloat b)       { return vcltq_f32(a, b); }
+static inline vmask vLe(vfloat a, vfloat b)       { return vcleq_f32(a, b); }
+static inline vmask vNe(vfloat a, vfloat b)       { return vmvnq_u32(vceqq_f32(a, b)); }
+static inline vmask vAnd(vmask a, vmask b)        { return vandq_u32(a, b); }
+static inline void vStoreMask(uint32_t *p, vmask a) { vst1q_u32(p, a); }
+
+#else
+
+#define CONVERT_LANES 0
+#define CONVERT_ISA "scalar"
+
+#endif
+
+void convertDetectedObjs(const mmwDetectedObjs &objs, float xyzScale, const mmwUnitTables &tables,
+                         const uint8_t *noiseProfile, size_t numNoiseBins, mmwDetectedPoints &points)
+{
+    size_t count = objs.x.size();
+    size_t i = 0;
+    
+    points.x.resize(count);
+    points.y.resize(count);
+    points.z.resize(count);
+    points.intensity.resize(count);
+    points.range.resize(count);
+    points.doppler.resize(count);
+    points.snr.resize(count);
+    points.noise.resize(count);
+    
+    if(noiseProfile == NULL)
+    {
+        numNoiseBins = 0;
+    }
+
+#if CONVERT_LANES > 0
+    vfloat scale = vSplat(xyzScale);
+    vfloat negScale = vSplat(-xyzScale);
+    
+    for(; i + CONVERT_LANES <= count; i += CONVERT_LANES)
+    {
+        vStore(&points.x[i], vMul(vLoadS16(&objs.y[i]), scale));
+        vStore(&points.y[i], vMul(vLoadS16(&objs.x[i]), negScale));
+        vStore(&points.z[i], vMul(vLoadS16(&objs.z[i]), scale));
+    }
+#endif
+    
+    convertDetectedObjsScalar(objs, xyzScale, points, i, count);
+    
+    // Intensity, range and doppler are table lookups by the raw field value, noise is looked up by range bin
+    for(i = 0; i < count; i++)
+    {
+        points.intensity[i] = tables.intensityDb[objs.peakVal[i]];
+        points.range[i] = tables.rangeMeters[objs.rangeIdx[i]];
+        points.doppler[i] = tables.dopplerMps[objs.dopplerIdx[i]];
+        
+        if(objs.rangeIdx[i] < numNoiseBins)
+        {
+            uint16_t noise = loadU16(noiseProfile + objs.rangeIdx[i] * sizeof(uint16_t));
+            
+            points.snr[i] = ((int) objs.peakVal[i] - (int) noise) * LOG_MAG_TO_DB;
+            points.noise[i] = noise * LOG_MAG_TO_DB;
+        }
+        else
+        {
+            points.snr[i] = 0;
+            points.noise[i] = 0;
+        }
+    }
+}
+
+/*Keep flag of point i, the same test as the vector loop*/
+static inline uint32_t keepPoint(const mmwDetectedPoints &points, const mmwPointFilter &filter, size_t i)
+{
+    return pointPassesFilter(filter, points.x[i], points.y[i], points.z[i], points.range[i], points.doppler[i], points.intensity[i]);
+}
+
+size_t selectDetectedPoints(const mmwDetectedPoints &points, const mmwPointFilter &filter, std::vector<uint32_t> &selected)
+{
+    size_t count = points.x.size();
+    size_t numSelected = 0;
+    size_t i = 0;
+    
+    /*Every index is written, numSelected only advances past the kept ones (stream compaction without branches)*/
+    selected.resize(count + 1);
+
+#if CONVERT_LANES > 0
+    vfloat elevationRatioSquared = vSplat(filter.elevationRatioSquared);
+    vfloat azimuthRatio = vSplat(filter.azimuthRatio);
+    vfloat zero = vSplat(0);
+    vfloat minRange = vSplat(filter.minRange);
+    vfloat maxRange = vSplat(filter.maxRange);
+    vfloat minDoppler = vSplat(filter.minDoppler);
+    vfloat maxDoppler = vSplat(filter.maxDoppler);
+    vfloat minIntensity = vSplat(filter.minIntensity);
+    vfloat maxIntensity = vSplat(filter.maxIntensity);
+    uint32_t keep[CONVERT_LANES];
+    
+    for(; i + CONVERT_LANES <= count; i += CONVERT_LANES)
+    {
+        vfloat x = vLoad(&points.x[i]);
+        vfloat y = vLoad(&points.y[i]);
+        vfloat z = vLoad(&points.z[i]);
+        vfloat range = vLoad(&points.range[i]);
+        vfloat doppler = vLoad(&points.doppler[i]);
+        vfloat intensity = vLoad(&points.intensity[i]);
+        
+        // Angles are compared as z^2 < tan^2(elevation)*(x^2+y^2) and |y| < tan(azimuth)*|x|, no division
+        vmask mask = vLt(vMul(z, z), vMul(elevationRatioSquared, vAdd(vMul(x, x), vMul(y, y))));
+        mask = vAnd(mask, vLt(vAbs(y), vMul(azimuthRatio, vAbs(x))));
+        mask = vAnd(mask, vNe(x, zero));
+        mask = vAnd(mask, vAnd(vLe(minRange, range), vLe(range, maxRange)));
+        mask = vAnd(mask, vAnd(vLe(minDoppler, doppler), vLe(doppler, maxDoppler)));
+        mask = vAnd(mask, vAnd(vLe(minIntensity, intensity), vLe(intensity, maxIntensity)));
+        vStoreMask(keep, mask);
+        
+        for(int j = 0; j < CONVERT_LANES; j++)
+        {
+            selected[numSelected] = i + j;
+            numSelected += keep[j] & 1;
+        }
+    }
+#endif
+    
+    for(; i < count; i++)
+    {
+        selected[numSelected] = i;
+        numSelected += keepPoint(points, filter, i);
+    }
+    
+    selected.resize(numSelected);
+    
+    return numSelected;
+}
+
+bool decodeDetectedObjsTlv(const FrameView &tlv, const FrameView &noiseProfile, const mmwUnitTables &tables, const mmwPointFilter &filter,
+                           mmwDataPacket &data, mmwDetectedPoints &points, std::vector<uint32_t> &selected)
+{
+    //make sure the TLV has the number of objects and xyzQFormat (4 bytes) before we read them
+    if(!tlv.contains(0, sizeof(data.numObjOut) + sizeof(data.xyzQFormat)))
+    {
+        return false;
+    }
+    
+    data.numObjOut = tlv.get<uint16_t>(0);
+    data.xyzQFormat = tlv.get<uint16_t>(sizeof(data.numObjOut));
+    
+    //make sure the whole object array fits in the TLV before decoding it
+    if(!tlv.contains(sizeof(data.numObjOut) + sizeof(data.xyzQFormat), data.numObjOut * sizeof(MmwDemo_DetectedObj)))
+    {
+        return false;
+    }
+    
+    //decode the whole object array (range index, doppler index, peak value, x, y, z) in one pass
+    decodeDetectedObjs(tlv.data() + sizeof(data.numObjOut) + sizeof(data.xyzQFormat), data.numObjOut, data.objOut);
+    
+    //convert from Qformat and bin indices to meters, m/s and dB, SNR and noise only if there is a noise profile
+    convertDetectedObjs(data.objOut, ldexpf(1.0f, -data.xyzQFormat), tables,
+                        (noiseProfile.size() > 0) ? noiseProfile.data() : NULL, noiseProfile.size() / sizeof(uint16_t), points);
+    
+    //keep the points inside the field of view and the range/doppler/intensity gates
+    data.numObjOut = selectDetectedPoints(points, filter, selected);
+    
+    return true;
+}
+
+void decodeLogMagProfile(const uint8_t *src, size_t count, float *db)
+{
+    size_t i = 0;
+
+#if CONVERT_LANES > 0
+    vfloat vscale = vSplat(LOG_MAG_TO_DB);
+    
+    for(; i + CONVERT_LANES <= count; i += CONVERT_LANES)
+    {
+        vStore(&db[i], vMul(vLoadU16(src + i * sizeof(uint16_t)), vscale));
+    }
+#endif
+    
+    for(; i < count; i++)
+    {
+        db[i] = loadU16(src + i * sizeof(uint16_t)) * LOG_MAG_TO_DB;
+    }
+}
+
+void decodeRangeDopplerHeatmap(const uint8_t *src, size_t numRangeBins, size_t numDopplerBins, float *db)
+{
+    size_t half = numDopplerBins / 2;
+    
+    /*fftshift is a swap of the two halves of each row, both are contiguous and go through the vector kernel*/
+    for(size_t r = 0; r < numRangeBins; r++)
+    {
+        const uint8_t *row = src + r * numDopplerBins * sizeof(uint16_t);
+        float *out = db + r * numDopplerBins;
+        
+        decodeLogMagProfile(row, numDopplerBins - half, out + half);
+        decodeLogMagProfile(row + (numDopplerBins - half) * sizeof(uint16_t), half, out);
+    }
+}
+
+void normalizeToMono8(const float *src, size_t count, uint8_t *dst)
+{
+    float minValue = INFINITY;
+    float maxValue = -INFINITY;
+    float scale;
+    
+    for(size_t i = 0; i < count; i++)
+    {
+        minValue = std::min(minValue, src[i]);
+        maxValue = std::max(maxValue, src[i]);
+    }
+    
+    // A flat image maps to 0
+    scale = (maxValue > minValue) ? 255.0f / (maxValue - minValue) : 0;
+    
+    for(size_t i = 0; i < count; i++)
+    {
+        dst[i] = (uint8_t) ((src[i] - minValue) * scale + 0.5f);
+    }
+}
+
+const char *convertDetectedObjsIsa(void)
+{
+    return CONVERT_ISA;
+}
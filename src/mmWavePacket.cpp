@@ -0,0 +1,384 @@
+/*
+ * mmWavePacket.cpp
+ *
+ * This is the implementation of mmWavePacket.h
+ *
+*/
+
+#include <mmWavePacket.h>
+#include <cstring>
+#include <algorithm>
+
+uint32_t maxPacketLenFor(const mmwChirpConfig &config)
+{
+    uint32_t len;
+    
+    len = sizeof(magicWord) + sizeof(MmwDemo_output_message_header_t);
+    len += 8 + 4 + MAX_DETECTED_OBJ * sizeof(DPIF_PointCloudCartesian);                                   // detected points (the SDK 2.x points are the larger)
+    len += 8 + MAX_DETECTED_OBJ * sizeof(DPIF_PointCloudSideInfo);                                         // detected points side info
+    len += 2 * (8 + config.numRangeBins * sizeof(uint16_t));                                               // range and noise profiles
+    len += 8 + config.numRangeBins * config.numTxAnt * config.numRxAnt * 2 * sizeof(int16_t);              // azimuth static heatmap
+    len += 8 + config.numRangeBins * config.numDopplerBins * sizeof(uint16_t);                             // range/doppler heatmap
+    len += 8 + sizeof(MmwDemo_output_message_stats);                                                       // stats
+    len += PACKET_SEGMENT_LEN;
+    
+    return len;
+}
+
+int packetLayout(uint32_t version, uint32_t platform)
+{
+    uint32_t major = (version >> 24) & 0xFF;
+    uint32_t minor = (version >> 16) & 0xFF;
+    
+    switch(platform & 0xFFFF)
+    {
+    case 0x1443:  // IWR1443
+        //the SDK 1.x 14xx demo never sent subFrameNumber, from SDK 2.0 on it sends what the other devices do
+        if(major >= 2)
+        {
+            return MMW_LAYOUT_SDK2;
+        }
+        return MMW_LAYOUT_SHORT_HEADER;
+    case 0x1642:  // IWR1642
+    case 0x1843:  // IWR1843
+    case 0x6843:  // IWR6843
+        //subFrameNumber was added in SDK 1.1, the float point cloud in SDK 2.0
+        if((major < 1) || ((major == 1) && (minor < 1)))
+        {
+            return MMW_LAYOUT_SHORT_HEADER;
+        }
+        else if(major < 2)
+        {
+            return MMW_LAYOUT_LONG_HEADER;
+        }
+        return MMW_LAYOUT_SDK2;
+    default:
+        return MMW_LAYOUT_UNKNOWN;
+    }
+}
+
+uint32_t packetHeaderSize(uint32_t version, uint32_t platform)
+{
+    //header size (which is based on platform and SDK version) does not include magicWord
+    if(packetLayout(version, platform) == MMW_LAYOUT_SHORT_HEADER)
+    {
+        return mmwLayoutTraits<MMW_LAYOUT_SHORT_HEADER>::HEADER_SIZE;
+    }
+    else
+    {
+        return mmwLayoutTraits<MMW_LAYOUT_LONG_HEADER>::HEADER_SIZE;
+    }
+}
+
+int checkPacketHeader(const uint8_t *packet, size_t len, uint32_t maxPacketLen, uint32_t &packetLen)
+{
+    uint32_t version, platform, headerSize, numDetectedObj, numTLVs;
+    
+    memcpy(&version, &packet[sizeof(magicWord)], sizeof(version));
+    memcpy(&packetLen, &packet[sizeof(magicWord) + 4], sizeof(packetLen));
+    memcpy(&platform, &packet[sizeof(magicWord) + 8], sizeof(platform));
+    
+    /*SDK major version 1 to 3*/
+    if((((version >> 24) & 0xFF) < 1) || (((version >> 24) & 0xFF) > 3))
+    {
+        return 0;
+    }
+    
+    /*Known device*/
+    if(packetLayout(version, platform) == MMW_LAYOUT_UNKNOWN)
+    {
+        return 0;
+    }
+    
+    headerSize = packetHeaderSize(version, platform);
+    if(len < sizeof(magicWord) + headerSize)
+    {
+        return -1;
+    }
+    
+    memcpy(&numDetectedObj, &packet[sizeof(magicWord) + 20], sizeof(numDetectedObj));
+    memcpy(&numTLVs, &packet[sizeof(magicWord) + 24], sizeof(numTLVs));
+    
+    /*Plausible counts, and room for the header and every TLV header*/
+    if((numDetectedObj > MAX_DETECTED_OBJ) || (numTLVs > MAX_NUM_TLVS))
+    {
+        return 0;
+    }
+    
+    if((packetLen < sizeof(magicWord) + headerSize + numTLVs * 8) || (packetLen > maxPacketLen))
+    {
+        return 0;
+    }
+    
+    return 1;
+}
+
+/*Sets end to the offset behind the last TLV of a complete packet, returns false if a TLV does not end inside the packet*/
+static bool tlvChainEnd(const uint8_t *packet, uint32_t packetLen, uint32_t &end)
+{
+    uint32_t version, platform, numTLVs, tlvLen;
+    uint32_t offset;
+    
+    memcpy(&version, &packet[sizeof(magicWord)], sizeof(version));
+    memcpy(&platform, &packet[sizeof(magicWord) + 8], sizeof(platform));
+    memcpy(&numTLVs, &packet[sizeof(magicWord) + 24], sizeof(numTLVs));
+    
+    /*Walk the TLV headers, each TLV has to end inside the packet*/
+    offset = sizeof(magicWord) + packetHeaderSize(version, platform);
+    for(uint32_t n = 0; n < numTLVs; n++)
+    {
+        if(offset + 8 > packetLen)
+        {
+            return false;
+        }
+        
+        memcpy(&tlvLen, &packet[offset + 4], sizeof(tlvLen));
+        if(tlvLen > packetLen - offset - 8)
+        {
+            return false;
+        }
+        
+        offset += 8 + tlvLen;
+    }
+    
+    end = offset;
+    
+    return (offset <= packetLen);
+}
+
+bool isValidTlvChain(const uint8_t *packet, uint32_t packetLen)
+{
+    uint32_t end;
+    
+    return tlvChainEnd(packet, packetLen, end);
+}
+
+bool tlvChainFillsPacket(const uint8_t *packet, uint32_t packetLen)
+{
+    uint32_t end;
+    
+    return tlvChainEnd(packet, packetLen, end) && (packetLen - end < PACKET_SEGMENT_LEN);
+}
+
+size_t findPacketStart(const uint8_t *packet, size_t packetLen, size_t len, uint32_t maxPacketLen, bool &undecided, size_t minPrefix)
+{
+    size_t pos = sizeof(magicWord);
+    size_t searchEnd = std::min(len, packetLen + sizeof(magicWord) - 1);
+    size_t found;
+    size_t k;
+    uint32_t nextLen;
+    int headerCheck;
+    
+    undecided = false;
+    
+    /*Search behind the packet's own magicWord for a magicWord (starting inside the packet) followed by a header that checks out*/
+    while(pos < packetLen)
+    {
+        found = findMagicWord(&packet[pos], searchEnd - pos) + pos;
+        if(found >= packetLen)
+        {
+            break;
+        }
+        
+        headerCheck = -1;
+        if(len - found >= sizeof(magicWord) + MIN_HEADER_SIZE)
+        {
+            headerCheck = checkPacketHeader(&packet[found], len - found, maxPacketLen, nextLen);
+        }
+        
+        if(headerCheck == 1)
+        {
+            return found;
+        }
+        else if(headerCheck < 0)
+        {
+            undecided = true;
+        }
+        
+        pos = found + 1;
+    }
+    
+    /*The start of a magicWord cut off by the end of the received bytes can not be checked yet either*/
+    for(k = sizeof(magicWord) - 1; (k >= std::max(minPrefix, (size_t) 1)) && (len - k >= sizeof(magicWord)); k--)
+    {
+        if((len - k < packetLen) && (memcmp(&packet[len - k], magicWord, k) == 0))
+        {
+            undecided = true;
+            break;
+        }
+    }
+    
+    return packetLen;
+}
+
+int isMagicWord(const uint8_t *bytes)
+{
+    uint64_t word, magic;
+    
+    /*Compare all 8 bytes at once*/
+    memcpy(&word, bytes, sizeof(word));
+    memcpy(&magic, magicWord, sizeof(magic));
+    
+    return (word == magic);
+}
+
+size_t findMagicWord(const uint8_t *buf, size_t len)
+{
+    const uint8_t *p = buf;
+    const uint8_t *end = buf + len;
+    
+    if(len < sizeof(magicWord))
+    {
+        return len;
+    }
+    
+    /*memchr for the first byte of the magicWord (vectorized in libc), then a single 64-bit compare per candidate*/
+    while((p = (const uint8_t*) memchr(p, magicWord[0], (end - p) - (sizeof(magicWord) - 1))) != NULL)
+    {
+        if(isMagicWord(p))
+        {
+            return p - buf;
+        }
+        
+        if(++p > end - sizeof(magicWord))
+        {
+            break;
+        }
+    }
+    
+    return len;
+}
+
+bool nextTlv(const FrameView &frame, uint32_t &offset, uint32_t &tlvType, FrameView &tlv)
+{
+    uint32_t tlvLen;
+    
+    if(!frame.contains(offset, sizeof(tlvType) + sizeof(tlvLen)))
+    {
+        return false;
+    }
+    
+    tlvLen = frame.get<uint32_t>(offset + sizeof(tlvType));
+    if(!frame.contains(offset + sizeof(tlvType) + sizeof(tlvLen), tlvLen))
+    {
+        return false;
+    }
+    
+    tlvType = frame.get<uint32_t>(offset);
+    tlv = frame.sub(offset + sizeof(tlvType) + sizeof(tlvLen), tlvLen);
+    offset += sizeof(tlvType) + sizeof(tlvLen) + tlvLen;
+    
+    return true;
+}
+
+mmwFramer::mmwFramer(uint32_t myMaxPacketLen) : synced(false), maxPacketLen(myMaxPacketLen)
+{
+}
+
+void mmwFramer::setMaxPacketLen(uint32_t myMaxPacketLen)
+{
+    maxPacketLen = myMaxPacketLen;
+}
+
+uint32_t mmwFramer::getMaxPacketLen(void) const
+{
+    return maxPacketLen;
+}
+
+int mmwFramer::next(const uint8_t *buf, size_t len, size_t &n, bool decide)
+{
+    size_t magicPos;
+    uint32_t packetLen;
+    int headerCheck;
+    bool undecided;
+    
+    n = 0;
+    
+    while(true)
+    {
+        /*magicWord check to (re)synchronize with the data stream*/
+        if(!synced)
+        {
+            magicPos = findMagicWord(buf, len);
+            if(magicPos == len)
+            {
+                /*Keep only the tail that may hold the start of a magicWord split across reads*/
+                if(len >= sizeof(magicWord))
+                {
+                    n = len - (sizeof(magicWord) - 1);
+                    return MMW_FRAMER_SKIP;
+                }
+                return MMW_FRAMER_NEED_DATA;
+            }
+            synced = true;
+            if(magicPos > 0)
+            {
+                n = magicPos;
+                return MMW_FRAMER_SKIP;
+            }
+        }
+        
+        /*Wait for the magicWord and the shortest (XWR14xx) header*/
+        if(len < sizeof(magicWord) + MIN_HEADER_SIZE)
+        {
+            return MMW_FRAMER_NEED_DATA;
+        }
+        
+        /*Packet does not start where the previous one said it would, fall back to searching for the magicWord*/
+        if(!isMagicWord(buf))
+        {
+            synced = false;
+            continue;
+        }
+        
+        break;
+    }
+    
+    headerCheck = checkPacketHeader(buf, len, maxPacketLen, packetLen);
+    
+    /*Wait for the rest of a longer header*/
+    if(headerCheck < 0)
+    {
+        return MMW_FRAMER_NEED_DATA;
+    }
+    
+    /*Skip this magicWord and search for the next one*/
+    if(headerCheck == 0)
+    {
+        synced = false;
+        n = 1;
+        return MMW_FRAMER_BAD_HEADER;
+    }
+    
+    /*Complete as soon as totalPacketLen bytes are in*/
+    if(len < packetLen)
+    {
+        return MMW_FRAMER_NEED_PAYLOAD;
+    }
+    
+    /*A valid header inside the packet means bytes were lost and the next packet already started, drop only this packet and continue from there.
+      If the TLVs fill the packet, bytes lost inside a TLV are still possible, but a packet merely ending in the first
+      few bytes of a magicWord (e.g. 0x02) is not held back for them*/
+    magicPos = findPacketStart(buf, packetLen, len, maxPacketLen, undecided,
+                               tlvChainFillsPacket(buf, packetLen) ? MIN_FILLED_PACKET_PREFIX : 1);
+    if(magicPos < packetLen)
+    {
+        n = magicPos;
+        return MMW_FRAMER_CUT_SHORT;
+    }
+    
+    /*The end of the packet looks like the start of the next one, wait for more bytes to tell*/
+    if(undecided && !decide)
+    {
+        return MMW_FRAMER_UNDECIDED;
+    }
+    
+    /*The next packet is expected right after this one either way*/
+    n = packetLen;
+    if(!isValidTlvChain(buf, packetLen))
+    {
+        return MMW_FRAMER_BAD_TLVS;
+    }
+    
+    return MMW_FRAMER_PACKET;
+}
@@ -45,6 +45,64 @@
 #include <stdio.h>
 #include <string>
 
+/* Stores the chirp and frame parameters of one config command (and counts chirpCfg commands) under /mmWave_Manager */
+static void setConfigParams(ros::NodeHandle &n, std::string comm, int &txAntennas)
+{
+  size_t pos = 0;
+  int i = 0;
+
+  std::string cmd;
+  std::string token;
+  while ((pos = comm.find(" ")) != std::string::npos) {
+    token = comm.substr(0, pos);
+    if(!token.compare("chirpCfg")){
+      txAntennas++;
+    } 
+    
+    if(i == 0){
+      cmd = token;
+    } else if(!cmd.compare("frameCfg")){
+      if(i==1){
+        n.setParam("/mmWave_Manager/chirpStartIdx", std::stoi(token));
+      } else if(i==2){
+        n.setParam("/mmWave_Manager/chirpEndIdx", std::stoi(token));
+      } else if(i==3){
+        n.setParam("/mmWave_Manager/numLoops", std::stoi(token));
+      } else if(i==4){
+        n.setParam("/mmWave_Manager/numFrames", std::stoi(token));
+      } else if(i==5){
+        n.setParam("/mmWave_Manager/framePeriodicity", std::stof(token));
+      }
+    } else if(!cmd.compare("channelCfg")){
+      if(i==1){
+        int rxChannelEn = std::stoi(token);
+        int numRxAnt = 0;
+        while(rxChannelEn){
+          numRxAnt += rxChannelEn & 1;
+          rxChannelEn >>= 1;
+        }
+        n.setParam("/mmWave_Manager/numRxAnt", numRxAnt);
+      }
+    } else if(!cmd.compare("profileCfg")){
+      if(i==2){
+        n.setParam("/mmWave_Manager/startFreq", std::stof(token));
+      } else if(i==3){
+        n.setParam("/mmWave_Manager/idleTime", std::stof(token));
+      } else if(i==5){
+        n.setParam("/mmWave_Manager/rampEndTime", std::stof(token));
+      } else if(i==8){
+        n.setParam("/mmWave_Manager/freqSlopeConst", std::stof(token));
+      } else if(i==10){
+        n.setParam("/mmWave_Manager/numAdcSamples", std::stoi(token));
+      } else if(i==11){
+        n.setParam("/mmWave_Manager/digOutSampleRate", std::stof(token));
+      } 
+    }
+    comm.erase(0, pos + 1);
+    i++;
+  }
+}
+
 int main(int argc, char **argv)
 {
   ros::init(argc, argv, "mmWaveQuickConfig");
@@ -59,12 +117,24 @@ int main(int argc, char **argv)
   }
   
   ros::NodeHandle n;
+  ros::NodeHandle private_nh("~");
   ros::ServiceClient client = n.serviceClient<ti_mmwave_rospkg::mmWaveCLI>("/mmWaveCommSrv/mmWaveCLI");
   ti_mmwave_rospkg::mmWaveCLI srv;
   std::ifstream myParams;
   
+  // Without a sensor (replayed or bridged data stream) only the parameters are taken from the config file
+  bool parseOnly = false;
+  private_nh.param("parse_only", parseOnly, false);
+  
   //wait for service to become available
-  ros::service::waitForService("/mmWaveCommSrv/mmWaveCLI", 100000); 
+  if (parseOnly)
+  {
+    ROS_INFO("mmWaveQuickConfig: parse_only is set, config file is not sent to the mmWave device");
+  }
+  else
+  {
+    ros::service::waitForService("/mmWaveCommSrv/mmWaveCLI", 100000); 
+  }
   
   int txAntennas = 0;
   myParams.open(argv[1]);
@@ -87,6 +157,13 @@ int main(int argc, char **argv)
           ROS_INFO("mmWaveQuickConfig: Ignored blank or comment line: '%s'", srv.request.comm.c_str() );
       }
 
+      // Only take the parameters from the command
+      else if (parseOnly)
+      {
+        ROS_INFO("mmWaveQuickConfig: Parsing command: '%s'", srv.request.comm.c_str() );
+        setConfigParams(n, srv.request.comm, txAntennas);
+      }
+
       // Send commands to mmWave sensor
       else
       {
@@ -103,49 +180,7 @@ int main(int argc, char **argv)
             {
                 ROS_INFO("mmWaveQuickConfig: Command successful (mmWave sensor responded with 'Done')");
               
-                size_t pos = 0;
-                int i = 0;
-
-                std::string cmd;
-                std::string token;
-                while ((pos = srv.request.comm.find(" ")) != std::string::npos) {
-                    token = srv.request.comm.substr(0, pos);
-                    if(!token.compare("chirpCfg")){
-                        txAntennas++;
-                    } 
-                    
-                    if(i == 0){
-                        cmd = token;
-                    } else if(!cmd.compare("frameCfg")){
-                        if(i==1){
-                            n.setParam("/mmWave_Manager/chirpStartIdx", std::stoi(token));
-                        } else if(i==2){
-                            n.setParam("/mmWave_Manager/chirpEndIdx", std::stoi(token));
-                        } else if(i==3){
-                            n.setParam("/mmWave_Manager/numLoops", std::stoi(token));
-                        } else if(i==4){
-                            n.setParam("/mmWave_Manager/numFrames", std::stoi(token));
-                        } else if(i==5){
-                            n.setParam("/mmWave_Manager/framePeriodicity", std::stof(token));
-                        }
-                    } else if(!cmd.compare("profileCfg")){
-                        if(i==2){
-                            n.setParam("/mmWave_Manager/startFreq", std::stof(token));
-                        } else if(i==3){
-                            n.setParam("/mmWave_Manager/idleTime", std::stof(token));
-                        } else if(i==5){
-                            n.setParam("/mmWave_Manager/rampEndTime", std::stof(token));
-                        } else if(i==8){
-                            n.setParam("/mmWave_Manager/freqSlopeConst", std::stof(token));
-                        } else if(i==10){
-                            n.setParam("/mmWave_Manager/numAdcSamples", std::stoi(token));
-                        } else if(i==11){
-                            n.setParam("/mmWave_Manager/digOutSampleRate", std::stof(token));
-                        } 
-                    }
-                    srv.request.comm.erase(0, pos + 1);
-                    i++;
-                }
+                setConfigParams(n, srv.request.comm, txAntennas);
 	            break;
             }
             else if (numTries == 0)
@@ -0,0 +1,257 @@
+/*
+ * bench_decode.cpp
+ *
+ * Micro-benchmark of the detected objects path of the sort thread: the
+ * per-point conversion the driver used to do (pow() and log10() per point)
+ * against decodeDetectedObjs, convertDetectedObjs and selectDetectedPoints.
+ * Both paths are checked against each other before timing, the exit status
+ * is non-zero if they disagree. Built with -DMMWAVE_BUILD_BENCHMARK=ON,
+ * needs no ROS.
+ *
+ * usage: mmwave_bench_decode [points per packet] [packets]
+ *
+*/
+
+#include <mmWaveDecode.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#define BENCH_NUM_DOPPLER_BINS 64
+#define BENCH_RANGE_IDX_TO_METERS 0.044f
+#define BENCH_DOPPLER_RES_TO_MPS 0.13f
+#define BENCH_XYZ_Q_FORMAT 9
+#define BENCH_XYZ_LSB (1.0f / (1 << BENCH_XYZ_Q_FORMAT))
+#define BENCH_REL_TOLERANCE 1e-5f
+
+/*Point as the sort thread fills it, without PCL*/
+struct BenchPoint
+{
+    float x;
+    float y;
+    float z;
+    float intensity;
+    float range;
+    float doppler;
+};
+
+/*Conversion and field of view check one point at a time, the way sortDetectedObjs did before the batch decoders.
+  Its sign extension (-= 65535) is one LSB off for negative values, 0xFFFF giving 0 instead of -1, which the batch
+  decoders fix on purpose*/
+static size_t convertPerPoint(const uint8_t *src, size_t count, float maxElevationAngleRatioSquared, float maxAzimuthAngleRatio, BenchPoint *out)
+{
+    MmwDemo_DetectedObj obj;
+    size_t numKept = 0;
+    
+    for(size_t n = 0; n < count; n++)
+    {
+        memcpy(&obj.rangeIdx, src + n * 12, 2);
+        memcpy(&obj.dopplerIdx, src + n * 12 + 2, 2);
+        memcpy(&obj.peakVal, src + n * 12 + 4, 2);
+        memcpy(&obj.x, src + n * 12 + 6, 2);
+        memcpy(&obj.y, src + n * 12 + 8, 2);
+        memcpy(&obj.z, src + n * 12 + 10, 2);
+        
+        int data[6];
+        data[0] = obj.x;
+        data[1] = obj.y;
+        data[2] = obj.z;
+        data[3] = obj.peakVal;
+        data[4] = obj.rangeIdx;
+        data[5] = obj.dopplerIdx;
+        for(int j = 0; j < 6; j++)
+        {
+            if(data[j] > 32767)
+                data[j] -= 65535;
+        }
+        
+        float temp[6];
+        for(int j = 0; j < 3; j++)
+        {
+            temp[j] = ((float)data[j]) / pow(2, BENCH_XYZ_Q_FORMAT);
+        }
+        temp[3] = 10 * log10(data[3] + 1);
+        temp[4] = data[4] * BENCH_RANGE_IDX_TO_METERS;
+        if(data[5] > BENCH_NUM_DOPPLER_BINS/2-1)
+        {
+            data[5] -= BENCH_NUM_DOPPLER_BINS;
+        }
+        temp[5] = data[5] * BENCH_DOPPLER_RES_TO_MPS;
+        
+        BenchPoint &p = out[numKept];
+        p.x = temp[1];
+        p.y = -temp[0];
+        p.z = temp[2];
+        p.intensity = temp[3];
+        p.range = temp[4];
+        p.doppler = temp[5];
+        
+        if(((p.z * p.z) / (p.x * p.x + p.y * p.y) < maxElevationAngleRatioSquared) &&
+           (fabs(p.y / p.x) < maxAzimuthAngleRatio) &&
+           (p.x != 0))
+        {
+            numKept++;
+        }
+    }
+    
+    return numKept;
+}
+
+/*Returns true if a and b differ by at most tolerance, or by BENCH_REL_TOLERANCE of the larger one*/
+static bool closeEnough(float a, float b, float tolerance)
+{
+    return fabsf(a - b) <= std::max(tolerance, BENCH_REL_TOLERANCE * std::max(fabsf(a), fabsf(b)));
+}
+
+/*Returns true if the numKept points of the per point path in cloud are the points of the batch path selected[] picks,
+  in the same order. x/y/z may differ by one Q9 LSB, the per point sign extension being off by one for negative values*/
+static bool samePoints(const BenchPoint *cloud, size_t numKept, const mmwDetectedPoints &points,
+                       const std::vector<uint32_t> &selected, size_t numSelected)
+{
+    if(numKept != numSelected)
+    {
+        fprintf(stderr, "per point path keeps %zu points, batch path %zu\n", numKept, numSelected);
+        return false;
+    }
+    
+    for(size_t k = 0; k < numKept; k++)
+    {
+        const BenchPoint &p = cloud[k];
+        uint32_t i = selected[k];
+        
+        if(!closeEnough(p.x, points.x[i], BENCH_XYZ_LSB) ||
+           !closeEnough(p.y, points.y[i], BENCH_XYZ_LSB) ||
+           !closeEnough(p.z, points.z[i], BENCH_XYZ_LSB) ||
+           !closeEnough(p.intensity, points.intensity[i], 0) ||
+           !closeEnough(p.range, points.range[i], 0) ||
+           !closeEnough(p.doppler, points.doppler[i], 0))
+        {
+            fprintf(stderr, "kept point %zu (object %u) differs: per point (%g %g %g %g %g %g), batch (%g %g %g %g %g %g)\n",
+                    k, i, p.x, p.y, p.z, p.intensity, p.range, p.doppler,
+                    points.x[i], points.y[i], points.z[i], points.intensity[i], points.range[i], points.doppler[i]);
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+/*Returns the seconds per call of f, run packets times*/
+template <typename F>
+static double timePerCall(int packets, F f)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    
+    for(int i = 0; i < packets; i++)
+    {
+        f();
+    }
+    
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / packets;
+}
+
+int main(int argc, char **argv)
+{
+    int numPoints = (argc > 1) ? atoi(argv[1]) : 512;
+    int packets = (argc > 2) ? atoi(argv[2]) : 20000;
+    std::vector<uint8_t> tlv(numPoints * sizeof(MmwDemo_DetectedObj));
+    std::vector<BenchPoint> cloud(numPoints);
+    mmwChirpConfig config;
+    mmwUnitTables tables;
+    mmwPointFilter filter;
+    mmwDetectedObjs objs;
+    mmwDetectedPoints points;
+    std::vector<uint32_t> selected;
+    volatile size_t sink = 0;
+    size_t numKept, numSelected;
+    double perPoint, batch, convertOnly, selectOnly;
+    
+    if((numPoints <= 0) || (packets <= 0))
+    {
+        fprintf(stderr, "usage: %s [points per packet] [packets]\n", argv[0]);
+        return 1;
+    }
+    
+    /*Points up to 10 m ahead and to either side, so the 45 degree field of view keeps some and drops others. Points within
+      a few LSBs of its edges are drawn again, the one LSB sign extension difference could keep them on one path only*/
+    srand(1);
+    for(int n = 0; n < numPoints; n++)
+    {
+        uint16_t fields[6];
+        int x, y, z;
+        
+        do
+        {
+            x = (rand() % 20001 - 10000) * 512 / 1000;
+            y = (rand() % 10001) * 512 / 1000;
+            z = (rand() % 4001 - 2000) * 512 / 1000;
+        } while((abs(abs(x) - y) <= 2) || (fabs(abs(z) - hypot(x, y)) <= 2));
+        
+        fields[0] = rand() % 256;                       // rangeIdx
+        fields[1] = rand() % BENCH_NUM_DOPPLER_BINS;    // dopplerIdx
+        fields[2] = rand() % 4096;                      // peakVal
+        fields[3] = (uint16_t) (int16_t) x;
+        fields[4] = (uint16_t) (int16_t) y;
+        fields[5] = (uint16_t) (int16_t) z;
+        memcpy(&tlv[n * sizeof(MmwDemo_DetectedObj)], fields, sizeof(fields));
+    }
+    
+    config.numTxAnt = 2;
+    config.numRxAnt = 4;
+    config.numRangeBins = 256;
+    config.numDopplerBins = BENCH_NUM_DOPPLER_BINS;
+    config.rangeIdxToMeters = BENCH_RANGE_IDX_TO_METERS;
+    config.dopplerResolutionToMps = BENCH_DOPPLER_RES_TO_MPS;
+    buildUnitTables(config, tables);
+    
+    filter.elevationRatioSquared = tanf(45 * M_PI / 180) * tanf(45 * M_PI / 180);
+    filter.azimuthRatio = tanf(45 * M_PI / 180);
+    filter.minRange = -INFINITY;
+    filter.maxRange = INFINITY;
+    filter.minDoppler = -INFINITY;
+    filter.maxDoppler = INFINITY;
+    filter.minIntensity = -INFINITY;
+    filter.maxIntensity = INFINITY;
+    
+    /*Timing a path that gives other points is pointless*/
+    numKept = convertPerPoint(&tlv[0], numPoints, filter.elevationRatioSquared, filter.azimuthRatio, &cloud[0]);
+    decodeDetectedObjs(&tlv[0], numPoints, objs);
+    convertDetectedObjs(objs, ldexpf(1.0f, -BENCH_XYZ_Q_FORMAT), tables, NULL, 0, points);
+    numSelected = selectDetectedPoints(points, filter, selected);
+    if(!samePoints(&cloud[0], numKept, points, selected, numSelected))
+    {
+        fprintf(stderr, "per point and batch paths disagree, not timing them\n");
+        return 2;
+    }
+    printf("per point and batch paths agree, %zu of %d points kept\n", numKept, numPoints);
+    
+    perPoint = timePerCall(packets, [&]() {
+        sink += convertPerPoint(&tlv[0], numPoints, filter.elevationRatioSquared, filter.azimuthRatio, &cloud[0]);
+    });
+    
+    batch = timePerCall(packets, [&]() {
+        decodeDetectedObjs(&tlv[0], numPoints, objs);
+        convertDetectedObjs(objs, ldexpf(1.0f, -BENCH_XYZ_Q_FORMAT), tables, NULL, 0, points);
+        sink += selectDetectedPoints(points, filter, selected);
+    });
+    
+    convertOnly = timePerCall(packets, [&]() {
+        convertDetectedObjs(objs, ldexpf(1.0f, -BENCH_XYZ_Q_FORMAT), tables, NULL, 0, points);
+    });
+    
+    selectOnly = timePerCall(packets, [&]() {
+        sink += selectDetectedPoints(points, filter, selected);
+    });
+    
+    printf("%d points per packet, %d packets, convertDetectedObjs built for %s\n", numPoints, packets, convertDetectedObjsIsa());
+    printf("per point (before)       %8.1f Mpoints/s\n", numPoints / perPoint * 1e-6);
+    printf("decode+convert+select    %8.1f Mpoints/s (%.1fx)\n", numPoints / batch * 1e-6, perPoint / batch);
+    printf("  convertDetectedObjs    %8.1f Mpoints/s\n", numPoints / convertOnly * 1e-6);
+    printf("  selectDetectedPoints   %8.1f Mpoints/s\n", numPoints / selectOnly * 1e-6);
+    
+    return 0;
+}
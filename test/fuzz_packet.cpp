@@ -0,0 +1,166 @@
+/*
+ * fuzz_packet.cpp
+ *
+ * libFuzzer target running arbitrary bytes through what the DataUARTHandler
+ * threads do with received data: mmwFramer splits them into packets, the
+ * TLVs of every packet are walked with nextTlv and the detected points are
+ * checked and decoded by the functions the sort thread calls
+ * (decodeDetectedObjsTlv for SDK 1.x, decodePointCloudTlv for SDK 2.x and
+ * newer). The input is also taken as one packet as is, so the decoders see
+ * headers the framer would reject.
+ * Built with -DMMWAVE_BUILD_FUZZER=ON (clang), needs no ROS.
+ *
+*/
+
+#include <mmWavePacket.h>
+#include <mmWaveDecode.h>
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <vector>
+
+/*Largest packet the fuzzed framer accepts, what a 3 Tx 4 Rx 256x64 bins configuration allows*/
+#define FUZZ_MAX_PACKET_LEN 65536
+
+/*Stand-in for RadarPoint, which needs PCL*/
+struct FuzzPoint
+{
+    float x;
+    float y;
+    float z;
+    float intensity;
+    float range;
+    float doppler;
+    float snr;
+    float noise;
+};
+
+/*State kept across inputs, like the sort thread keeps it across packets*/
+struct FuzzState
+{
+    FuzzState()
+    {
+        mmwChirpConfig config;
+        
+        config.numTxAnt = 2;
+        config.numRxAnt = 4;
+        config.numRangeBins = 256;
+        config.numDopplerBins = 64;
+        config.rangeIdxToMeters = 0.044f;
+        config.dopplerResolutionToMps = 0.13f;
+        buildUnitTables(config, tables);
+        
+        filter.elevationRatioSquared = INFINITY;
+        filter.azimuthRatio = INFINITY;
+        filter.minRange = -INFINITY;
+        filter.maxRange = INFINITY;
+        filter.minDoppler = -INFINITY;
+        filter.maxDoppler = INFINITY;
+        filter.minIntensity = -INFINITY;
+        filter.maxIntensity = INFINITY;
+    }
+    
+    mmwUnitTables tables;
+    
+    mmwPointFilter filter;
+    
+    mmwDataPacket data;
+    
+    mmwDetectedPoints points;
+    
+    std::vector<uint32_t> selected;
+    
+    std::vector<FuzzPoint> cloud;
+};
+
+/*Walks the TLVs of one packet like sortPacketAs and decodes the points with the functions its handlers use*/
+static void sortPacket(FuzzState &state, const FrameView &frame)
+{
+    uint32_t version, platform, numDetectedObj, numTLVs, offset, tlvType;
+    FrameView tlv, pointCloudTlv, sideInfoTlv, noiseProfileTlv;
+    int layout;
+    
+    if(!frame.contains(0, sizeof(magicWord) + MIN_HEADER_SIZE))
+    {
+        return;
+    }
+    
+    version = frame.get<uint32_t>(sizeof(magicWord));
+    platform = frame.get<uint32_t>(sizeof(magicWord) + 8);
+    numDetectedObj = frame.get<uint32_t>(sizeof(magicWord) + 20);
+    numTLVs = frame.get<uint32_t>(sizeof(magicWord) + 24);
+    
+    layout = packetLayout(version, platform);
+    if(layout == MMW_LAYOUT_UNKNOWN)
+    {
+        return;
+    }
+    
+    offset = sizeof(magicWord) + packetHeaderSize(version, platform);
+    for(uint32_t n = 0; (n < numTLVs) && nextTlv(frame, offset, tlvType, tlv); n++)
+    {
+        if(tlvType == MMWDEMO_OUTPUT_MSG_DETECTED_POINTS)
+        {
+            pointCloudTlv = tlv;
+        }
+        else if(tlvType == MMWDEMO_OUTPUT_MSG_DETECTED_POINTS_SIDE_INFO)
+        {
+            sideInfoTlv = tlv;
+        }
+        else if(tlvType == MMWDEMO_OUTPUT_MSG_NOISE_PROFILE)
+        {
+            noiseProfileTlv = tlv;
+        }
+    }
+    
+    if(pointCloudTlv.size() == 0)
+    {
+        return;
+    }
+    
+    /*The TLV checks and decoders of sortPointCloud and sortDetectedObjs*/
+    if(layout == MMW_LAYOUT_SDK2)
+    {
+        decodePointCloudTlv(pointCloudTlv, sideInfoTlv, numDetectedObj, state.filter, state.cloud);
+    }
+    else
+    {
+        decodeDetectedObjsTlv(pointCloudTlv, noiseProfileTlv, state.tables, state.filter, state.data, state.points, state.selected);
+    }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    static FuzzState state;
+    mmwFramer framer(FUZZ_MAX_PACKET_LEN);
+    size_t pos = 0;
+    size_t n;
+    int frameResult;
+    
+    /*The input as a received stream*/
+    while(pos < size)
+    {
+        frameResult = framer.next(data + pos, size - pos, n);
+        if(frameResult == MMW_FRAMER_UNDECIDED)
+        {
+            /*No more bytes are coming, like the read thread after waiting UNDECIDED_TIMEOUT_NS*/
+            frameResult = framer.next(data + pos, size - pos, n, true);
+        }
+        if((frameResult == MMW_FRAMER_NEED_DATA) || (frameResult == MMW_FRAMER_NEED_PAYLOAD))
+        {
+            break;
+        }
+        
+        if(frameResult == MMW_FRAMER_PACKET)
+        {
+            sortPacket(state, FrameView(data + pos, n));
+        }
+        
+        pos += n;
+    }
+    
+    /*The input as one packet*/
+    sortPacket(state, FrameView(data, size));
+    
+    return 0;
+}
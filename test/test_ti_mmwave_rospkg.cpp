@@ -0,0 +1,812 @@
+/*
+ * test_ti_mmwave_rospkg.cpp
+ *
+ * Runs synthetic mmwDemo data streams through the packet framing the
+ * DataUARTHandler read thread uses (mmwFramer and the checks behind it),
+ * with lost bytes, magic words inside payload data and inflated packet
+ * lengths, delivered in reads of different sizes. Checks the decoders of
+ * the sort threads (mmWaveDecode) against known inputs.
+ *
+*/
+
+#include <gtest/gtest.h>
+#include <mmWavePacket.h>
+#include <mmWaveDecode.h>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+
+/*Large enough for every synthetic packet, but not for one with 1024 extra bytes*/
+#define TEST_MAX_PACKET_LEN 1024
+
+/*Heap allocations are counted while countAllocations is set*/
+static bool countAllocations = false;
+static size_t numAllocations = 0;
+
+void *operator new(size_t size)
+{
+    void *p;
+    
+    if(countAllocations)
+    {
+        numAllocations++;
+    }
+    
+    p = malloc(size ? size : 1);
+    if(p == NULL)
+    {
+        throw std::bad_alloc();
+    }
+    
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+static void putU32(std::vector<uint8_t> &packet, size_t offset, uint32_t value)
+{
+    memcpy(&packet[offset], &value, sizeof(value));
+}
+
+/*IWR1642 SDK 1.2 packet (long header) with one detected objects TLV of numObj objects*/
+static std::vector<uint8_t> makePacket(uint32_t frameNumber, uint32_t numObj)
+{
+    size_t headerLen = sizeof(magicWord) + mmwLayoutTraits<MMW_LAYOUT_LONG_HEADER>::HEADER_SIZE;
+    size_t tlvLen = 4 + numObj * sizeof(MmwDemo_DetectedObj);
+    std::vector<uint8_t> packet(headerLen + 8 + tlvLen);
+    
+    memcpy(&packet[0], magicWord, sizeof(magicWord));
+    putU32(packet, 8, 0x01020000);              // version
+    putU32(packet, 12, packet.size());          // totalPacketLen
+    putU32(packet, 16, 0x000A1642);             // platform
+    putU32(packet, 20, frameNumber);
+    putU32(packet, 24, 0);                      // timeCpuCycles
+    putU32(packet, 28, numObj);                 // numDetectedObj
+    putU32(packet, 32, 1);                      // numTLVs
+    putU32(packet, 36, 0);                      // subFrameNumber
+    
+    putU32(packet, headerLen, MMWDEMO_OUTPUT_MSG_DETECTED_POINTS);
+    putU32(packet, headerLen + 4, tlvLen);
+    
+    /*numObj, xyzQFormat, then objects filled with a pattern that never contains the magicWord*/
+    packet[headerLen + 8] = numObj;
+    packet[headerLen + 10] = 7;
+    for(size_t i = headerLen + 12; i < packet.size(); i++)
+    {
+        packet[i] = 0x80 | (i & 0x7F);
+    }
+    
+    return packet;
+}
+
+/*SDK 3.x packet (long header) of platform with one detected points TLV of numObj DPIF points*/
+static std::vector<uint8_t> makeSdk3Packet(uint32_t platform, uint32_t frameNumber, uint32_t numObj)
+{
+    size_t headerLen = sizeof(magicWord) + mmwLayoutTraits<MMW_LAYOUT_SDK2>::HEADER_SIZE;
+    size_t tlvLen = numObj * sizeof(DPIF_PointCloudCartesian);
+    std::vector<uint8_t> packet(headerLen + 8 + tlvLen);
+    
+    memcpy(&packet[0], magicWord, sizeof(magicWord));
+    putU32(packet, 8, 0x03050000);              // version
+    putU32(packet, 12, packet.size());          // totalPacketLen
+    putU32(packet, 16, platform);
+    putU32(packet, 20, frameNumber);
+    putU32(packet, 24, 0);                      // timeCpuCycles
+    putU32(packet, 28, numObj);                 // numDetectedObj
+    putU32(packet, 32, 1);                      // numTLVs
+    putU32(packet, 36, 0);                      // subFrameNumber
+    
+    putU32(packet, headerLen, MMWDEMO_OUTPUT_MSG_DETECTED_POINTS);
+    putU32(packet, headerLen + 4, tlvLen);
+    for(size_t i = headerLen + 8; i < packet.size(); i++)
+    {
+        packet[i] = 0x80 | (i & 0x7F);
+    }
+    
+    return packet;
+}
+
+static uint32_t frameNumberOf(const std::vector<uint8_t> &packet, size_t offset)
+{
+    uint32_t frameNumber;
+    
+    memcpy(&frameNumber, &packet[offset + 20], sizeof(frameNumber));
+    
+    return frameNumber;
+}
+
+/*Result of running a stream through the framer*/
+struct FramedStream
+{
+    std::vector<uint32_t> frameNumbers;
+    
+    unsigned int resyncs;
+};
+
+/*Feeds stream to an mmwFramer in reads of 1 to maxChunk bytes and consumes what it returns the way the read thread does*/
+static FramedStream frameStream(const std::vector<uint8_t> &stream, size_t maxChunk)
+{
+    FramedStream result;
+    mmwFramer framer(TEST_MAX_PACKET_LEN);
+    std::vector<uint8_t> buf;
+    size_t pos = 0;
+    size_t chunk;
+    size_t n;
+    int frameResult;
+    
+    result.resyncs = 0;
+    srand(1);
+    
+    while(pos < stream.size())
+    {
+        chunk = std::min(stream.size() - pos, 1 + (size_t) rand() % maxChunk);
+        buf.insert(buf.end(), stream.begin() + pos, stream.begin() + pos + chunk);
+        pos += chunk;
+        
+        while(true)
+        {
+            frameResult = framer.next(buf.data(), buf.size(), n);
+            if((frameResult == MMW_FRAMER_NEED_DATA) || (frameResult == MMW_FRAMER_NEED_PAYLOAD) || (frameResult == MMW_FRAMER_UNDECIDED))
+            {
+                break;
+            }
+            
+            if(frameResult == MMW_FRAMER_PACKET)
+            {
+                result.frameNumbers.push_back(frameNumberOf(buf, 0));
+            }
+            else if(frameResult != MMW_FRAMER_SKIP)
+            {
+                result.resyncs++;
+            }
+            
+            EXPECT_GT(n, 0u);
+            EXPECT_LE(n, buf.size());
+            buf.erase(buf.begin(), buf.begin() + n);
+        }
+    }
+    
+    return result;
+}
+
+/*Stream of numFrames packets, frame numbers starting at 1, modify(packet) applied to packet number damaged*/
+template <typename Modify>
+static std::vector<uint8_t> makeStream(uint32_t numFrames, uint32_t damaged, Modify modify)
+{
+    std::vector<uint8_t> stream;
+    
+    /*Start in the middle of a packet, like a port opened while the sensor is running*/
+    std::vector<uint8_t> partial = makePacket(0, 5);
+    stream.insert(stream.end(), partial.begin() + 17, partial.end());
+    
+    for(uint32_t i = 1; i <= numFrames; i++)
+    {
+        std::vector<uint8_t> packet = makePacket(i, 1 + i % 9);
+        
+        if(i == damaged)
+        {
+            modify(packet);
+        }
+        stream.insert(stream.end(), packet.begin(), packet.end());
+    }
+    
+    return stream;
+}
+
+static void keepPacket(std::vector<uint8_t> &/*packet*/)
+{
+}
+
+static void loseBytes(std::vector<uint8_t> &packet)
+{
+    packet.erase(packet.begin() + 50, packet.begin() + 55);
+}
+
+static void addMagicWord(std::vector<uint8_t> &packet)
+{
+    memcpy(&packet[60], magicWord, sizeof(magicWord));
+}
+
+static void inflateLength(std::vector<uint8_t> &packet)
+{
+    putU32(packet, 12, packet.size() + 1024);
+}
+
+static void inflateLengthSlightly(std::vector<uint8_t> &packet)
+{
+    putU32(packet, 12, packet.size() + 200);
+}
+
+static std::vector<uint32_t> framesWithout(uint32_t numFrames, uint32_t missing)
+{
+    std::vector<uint32_t> frames;
+    
+    for(uint32_t i = 1; i <= numFrames; i++)
+    {
+        if(i != missing)
+        {
+            frames.push_back(i);
+        }
+    }
+    
+    return frames;
+}
+
+static const size_t chunkSizes[] = {1, 7, 64, 4096};
+
+TEST(PacketFraming, CleanStream)
+{
+    std::vector<uint8_t> stream = makeStream(20, 0, keepPacket);
+    
+    for(size_t c = 0; c < sizeof(chunkSizes) / sizeof(chunkSizes[0]); c++)
+    {
+        FramedStream framed = frameStream(stream, chunkSizes[c]);
+        
+        EXPECT_EQ(framesWithout(20, 0), framed.frameNumbers) << "reads of up to " << chunkSizes[c] << " bytes";
+        EXPECT_EQ(0u, framed.resyncs);
+    }
+}
+
+TEST(PacketFraming, LostBytes)
+{
+    std::vector<uint8_t> stream = makeStream(20, 8, loseBytes);
+    
+    /*Only the packet that lost bytes is dropped, the next one is found inside it*/
+    for(size_t c = 0; c < sizeof(chunkSizes) / sizeof(chunkSizes[0]); c++)
+    {
+        FramedStream framed = frameStream(stream, chunkSizes[c]);
+        
+        EXPECT_EQ(framesWithout(20, 8), framed.frameNumbers) << "reads of up to " << chunkSizes[c] << " bytes";
+        EXPECT_GT(framed.resyncs, 0u);
+    }
+}
+
+TEST(PacketFraming, SpuriousMagicWord)
+{
+    std::vector<uint8_t> stream = makeStream(20, 8, addMagicWord);
+    
+    /*A magicWord in payload data without a valid header behind it does not cut the packet short*/
+    for(size_t c = 0; c < sizeof(chunkSizes) / sizeof(chunkSizes[0]); c++)
+    {
+        FramedStream framed = frameStream(stream, chunkSizes[c]);
+        
+        EXPECT_EQ(framesWithout(20, 0), framed.frameNumbers) << "reads of up to " << chunkSizes[c] << " bytes";
+        EXPECT_EQ(0u, framed.resyncs);
+    }
+}
+
+TEST(PacketFraming, InflatedLength)
+{
+    std::vector<uint8_t> stream = makeStream(20, 8, inflateLength);
+    
+    /*A totalPacketLen above the maximum makes the header implausible, the framer resynchronizes on the next packet*/
+    for(size_t c = 0; c < sizeof(chunkSizes) / sizeof(chunkSizes[0]); c++)
+    {
+        FramedStream framed = frameStream(stream, chunkSizes[c]);
+        
+        EXPECT_EQ(framesWithout(20, 8), framed.frameNumbers) << "reads of up to " << chunkSizes[c] << " bytes";
+        EXPECT_GT(framed.resyncs, 0u);
+    }
+    
+    /*A plausible but too long totalPacketLen runs into the next packet, which is found inside it*/
+    stream = makeStream(20, 8, inflateLengthSlightly);
+    for(size_t c = 0; c < sizeof(chunkSizes) / sizeof(chunkSizes[0]); c++)
+    {
+        FramedStream framed = frameStream(stream, chunkSizes[c]);
+        
+        EXPECT_EQ(framesWithout(20, 8), framed.frameNumbers) << "reads of up to " << chunkSizes[c] << " bytes";
+        EXPECT_GT(framed.resyncs, 0u);
+    }
+}
+
+TEST(PacketFraming, FindPacketStart)
+{
+    std::vector<uint8_t> packet = makePacket(1, 4);
+    std::vector<uint8_t> next = makePacket(2, 4);
+    std::vector<uint8_t> buf;
+    bool undecided;
+    
+    /*The next packet right behind this one is not inside it*/
+    buf = packet;
+    buf.insert(buf.end(), next.begin(), next.end());
+    EXPECT_EQ(packet.size(), findPacketStart(buf.data(), packet.size(), buf.size(), TEST_MAX_PACKET_LEN, undecided));
+    EXPECT_FALSE(undecided);
+    
+    /*Bytes lost at the end of this packet, the next one starts inside it*/
+    buf.assign(packet.begin(), packet.end() - 10);
+    buf.insert(buf.end(), next.begin(), next.end());
+    EXPECT_EQ(packet.size() - 10, findPacketStart(buf.data(), packet.size(), buf.size(), TEST_MAX_PACKET_LEN, undecided));
+    
+    /*Same, but the next header is not complete yet*/
+    buf.assign(packet.begin(), packet.end() - 10);
+    buf.insert(buf.end(), next.begin(), next.begin() + 12);
+    EXPECT_EQ(packet.size(), findPacketStart(buf.data(), packet.size(), buf.size(), TEST_MAX_PACKET_LEN, undecided));
+    EXPECT_TRUE(undecided);
+}
+
+TEST(PacketFraming, EndsLikeMagicWord)
+{
+    std::vector<uint8_t> packet = makePacket(1, 4);
+    mmwFramer framer(TEST_MAX_PACKET_LEN);
+    bool undecided;
+    size_t n;
+    
+    /*Unpadded packet whose last byte is the first byte of a magicWord*/
+    packet.back() = magicWord[0];
+    findPacketStart(packet.data(), packet.size(), packet.size(), TEST_MAX_PACKET_LEN, undecided);
+    EXPECT_TRUE(undecided);
+    
+    /*The TLVs fill it, so it is whole and delivered without waiting for the next packet*/
+    EXPECT_EQ(MMW_FRAMER_PACKET, framer.next(packet.data(), packet.size(), n));
+    EXPECT_EQ(packet.size(), n);
+    
+    /*Bytes behind the TLVs (more than padding) leave it undecided until the caller decides*/
+    packet.insert(packet.end(), PACKET_SEGMENT_LEN, 0x55);
+    packet.back() = magicWord[0];
+    putU32(packet, 12, packet.size());
+    EXPECT_EQ(MMW_FRAMER_UNDECIDED, framer.next(packet.data(), packet.size(), n));
+    EXPECT_EQ(0u, n);
+    EXPECT_EQ(MMW_FRAMER_PACKET, framer.next(packet.data(), packet.size(), n, true));
+    EXPECT_EQ(packet.size(), n);
+}
+
+TEST(PacketFraming, Iwr1443Sdk3)
+{
+    std::vector<uint8_t> stream;
+    
+    /*Only SDK 1.x of the 14xx demo sends the short header*/
+    EXPECT_EQ(MMW_LAYOUT_SHORT_HEADER, packetLayout(0x01000000, 0x000A1443));
+    EXPECT_EQ(MMW_LAYOUT_SDK2, packetLayout(0x03050000, 0x000A1443));
+    EXPECT_EQ((uint32_t) mmwLayoutTraits<MMW_LAYOUT_SDK2>::HEADER_SIZE, packetHeaderSize(0x03050000, 0x000A1443));
+    
+    for(uint32_t i = 1; i <= 20; i++)
+    {
+        std::vector<uint8_t> packet = makeSdk3Packet(0x000A1443, i, i % 9);
+        
+        EXPECT_TRUE(isValidTlvChain(packet.data(), packet.size()));
+        stream.insert(stream.end(), packet.begin(), packet.end());
+    }
+    
+    for(size_t c = 0; c < sizeof(chunkSizes) / sizeof(chunkSizes[0]); c++)
+    {
+        FramedStream framed = frameStream(stream, chunkSizes[c]);
+        
+        EXPECT_EQ(framesWithout(20, 0), framed.frameNumbers) << "reads of up to " << chunkSizes[c] << " bytes";
+        EXPECT_EQ(0u, framed.resyncs);
+    }
+}
+
+TEST(PacketFraming, TlvChain)
+{
+    std::vector<uint8_t> packet = makePacket(1, 4);
+    size_t tlvLenOffset = sizeof(magicWord) + mmwLayoutTraits<MMW_LAYOUT_LONG_HEADER>::HEADER_SIZE + 4;
+    
+    EXPECT_TRUE(isValidTlvChain(packet.data(), packet.size()));
+    
+    /*TLV running past the end of the packet*/
+    putU32(packet, tlvLenOffset, packet.size());
+    EXPECT_FALSE(isValidTlvChain(packet.data(), packet.size()));
+    
+    /*numTLVs claiming a TLV the packet has no room for*/
+    packet = makePacket(1, 4);
+    putU32(packet, 32, 2);
+    EXPECT_FALSE(isValidTlvChain(packet.data(), packet.size()));
+}
+
+TEST(PacketFraming, NextTlv)
+{
+    std::vector<uint8_t> packet = makePacket(1, 4);
+    FrameView frame(packet.data(), packet.size());
+    uint32_t offset = sizeof(magicWord) + mmwLayoutTraits<MMW_LAYOUT_LONG_HEADER>::HEADER_SIZE;
+    uint32_t tlvType;
+    FrameView tlv;
+    
+    ASSERT_TRUE(nextTlv(frame, offset, tlvType, tlv));
+    EXPECT_EQ((uint32_t) MMWDEMO_OUTPUT_MSG_DETECTED_POINTS, tlvType);
+    EXPECT_EQ(4 + 4 * sizeof(MmwDemo_DetectedObj), tlv.size());
+    EXPECT_EQ(packet.size(), offset);
+    
+    /*Nothing left*/
+    EXPECT_FALSE(nextTlv(frame, offset, tlvType, tlv));
+    EXPECT_EQ(packet.size(), offset);
+}
+
+#define TEST_NUM_DOPPLER_BINS 64
+#define TEST_RANGE_IDX_TO_METERS 0.044f
+#define TEST_DOPPLER_RES_TO_MPS 0.13f
+
+/*Q9 log2 magnitude step in dB*/
+#define TEST_LOG_MAG_TO_DB (20.0f * 0.30103f / 512.0f)
+
+static void buildTestUnitTables(mmwUnitTables &tables)
+{
+    mmwChirpConfig config;
+    
+    config.numTxAnt = 2;
+    config.numRxAnt = 4;
+    config.numRangeBins = 256;
+    config.numDopplerBins = TEST_NUM_DOPPLER_BINS;
+    config.rangeIdxToMeters = TEST_RANGE_IDX_TO_METERS;
+    config.dopplerResolutionToMps = TEST_DOPPLER_RES_TO_MPS;
+    buildUnitTables(config, tables);
+}
+
+static mmwPointFilter acceptAllFilter(void)
+{
+    mmwPointFilter filter;
+    
+    filter.elevationRatioSquared = INFINITY;
+    filter.azimuthRatio = INFINITY;
+    filter.minRange = -INFINITY;
+    filter.maxRange = INFINITY;
+    filter.minDoppler = -INFINITY;
+    filter.maxDoppler = INFINITY;
+    filter.minIntensity = -INFINITY;
+    filter.maxIntensity = INFINITY;
+    
+    return filter;
+}
+
+/*Appends one packed MmwDemo_DetectedObj*/
+static void putObj(std::vector<uint8_t> &tlv, uint16_t rangeIdx, uint16_t dopplerIdx, uint16_t peakVal, uint16_t x, uint16_t y, uint16_t z)
+{
+    uint16_t fields[6] = {rangeIdx, dopplerIdx, peakVal, x, y, z};
+    
+    tlv.insert(tlv.end(), (const uint8_t *) fields, (const uint8_t *) fields + sizeof(fields));
+}
+
+TEST(Decode, DetectedObjsSignExtension)
+{
+    std::vector<uint8_t> tlv;
+    mmwUnitTables tables;
+    mmwDetectedObjs objs;
+    mmwDetectedPoints points;
+    float scale = 1.0f / 512;
+    
+    buildTestUnitTables(tables);
+    
+    /*x, y, z are int16 in Q9: 0x8000 is the most negative value, 0xFFFF is -1 (not 0)*/
+    putObj(tlv, 10, 0, 99, 0x8000, 0xFFFF, 0x0001);
+    putObj(tlv, 0, 0, 0, 0x7FFF, 0x0200, 0xFE00);
+    
+    /*More objects than a vector register holds, so the vector loop and the scalar tail both run*/
+    for(int i = 0; i < 17; i++)
+    {
+        putObj(tlv, 0, 0, 0, 0xFFFF, 0x8000, 0xFFFF);
+    }
+    
+    decodeDetectedObjs(tlv.data(), tlv.size() / sizeof(MmwDemo_DetectedObj), objs);
+    ASSERT_EQ(19u, objs.x.size());
+    EXPECT_EQ(-32768, objs.x[0]);
+    EXPECT_EQ(-1, objs.y[0]);
+    
+    convertDetectedObjs(objs, scale, tables, NULL, 0, points);
+    
+    /*ROS X forward = sensor y, Y left = sensor -x, Z up = sensor z*/
+    EXPECT_FLOAT_EQ(-1 * scale, points.x[0]);
+    EXPECT_FLOAT_EQ(32768 * scale, points.y[0]);
+    EXPECT_FLOAT_EQ(1 * scale, points.z[0]);
+    EXPECT_FLOAT_EQ(1.0f, points.x[1]);
+    EXPECT_FLOAT_EQ(-32767 * scale, points.y[1]);
+    EXPECT_FLOAT_EQ(-1.0f, points.z[1]);
+    for(size_t i = 2; i < points.x.size(); i++)
+    {
+        EXPECT_FLOAT_EQ(-32768 * scale, points.x[i]);
+        EXPECT_FLOAT_EQ(1 * scale, points.y[i]);
+        EXPECT_FLOAT_EQ(-1 * scale, points.z[i]);
+    }
+    
+    EXPECT_FLOAT_EQ(10 * TEST_RANGE_IDX_TO_METERS, points.range[0]);
+    EXPECT_FLOAT_EQ(20.0f, points.intensity[0]);
+    EXPECT_FLOAT_EQ(0.0f, points.intensity[1]);
+}
+
+TEST(Decode, DopplerWrap)
+{
+    mmwUnitTables tables;
+    
+    buildTestUnitTables(tables);
+    
+    /*Bins 0 to N/2-1 are zero and positive velocities, bins N/2 and above wrap to negative ones, negative int16 indices stay negative*/
+    EXPECT_FLOAT_EQ(0.0f, tables.dopplerMps[0]);
+    EXPECT_FLOAT_EQ(1 * TEST_DOPPLER_RES_TO_MPS, tables.dopplerMps[1]);
+    EXPECT_FLOAT_EQ((TEST_NUM_DOPPLER_BINS / 2 - 1) * TEST_DOPPLER_RES_TO_MPS, tables.dopplerMps[TEST_NUM_DOPPLER_BINS / 2 - 1]);
+    EXPECT_FLOAT_EQ(-(TEST_NUM_DOPPLER_BINS / 2) * TEST_DOPPLER_RES_TO_MPS, tables.dopplerMps[TEST_NUM_DOPPLER_BINS / 2]);
+    EXPECT_FLOAT_EQ(-1 * TEST_DOPPLER_RES_TO_MPS, tables.dopplerMps[TEST_NUM_DOPPLER_BINS - 1]);
+    EXPECT_FLOAT_EQ(-1 * TEST_DOPPLER_RES_TO_MPS, tables.dopplerMps[0xFFFF]);
+    EXPECT_FLOAT_EQ(-32768 * TEST_DOPPLER_RES_TO_MPS, tables.dopplerMps[0x8000]);
+}
+
+TEST(Decode, SnrFromNoiseProfile)
+{
+    std::vector<uint8_t> tlv;
+    std::vector<uint16_t> noiseProfile(4);
+    mmwUnitTables tables;
+    mmwDetectedObjs objs;
+    mmwDetectedPoints points;
+    
+    buildTestUnitTables(tables);
+    
+    /*Peak and noise floor are Q9 log2 magnitudes, 512 apart is a factor 2 (6.02 dB)*/
+    noiseProfile[2] = 512;
+    noiseProfile[3] = 2048;
+    putObj(tlv, 2, 0, 1024, 0x0200, 0x0200, 0);
+    putObj(tlv, 3, 0, 1024, 0x0200, 0x0200, 0);
+    putObj(tlv, 4, 0, 1024, 0x0200, 0x0200, 0);         // past the noise profile
+    
+    decodeDetectedObjs(tlv.data(), 3, objs);
+    convertDetectedObjs(objs, 1.0f / 512, tables, (const uint8_t *) noiseProfile.data(), noiseProfile.size(), points);
+    
+    EXPECT_NEAR(512 * TEST_LOG_MAG_TO_DB, points.snr[0], 1e-4);
+    EXPECT_NEAR(6.0206f, points.noise[0], 1e-3);
+    EXPECT_NEAR(-1024 * TEST_LOG_MAG_TO_DB, points.snr[1], 1e-4);
+    EXPECT_NEAR(2048 * TEST_LOG_MAG_TO_DB, points.noise[1], 1e-4);
+    EXPECT_EQ(0.0f, points.snr[2]);
+    EXPECT_EQ(0.0f, points.noise[2]);
+    
+    /*Without a noise profile every point has SNR and noise 0*/
+    convertDetectedObjs(objs, 1.0f / 512, tables, NULL, 0, points);
+    EXPECT_EQ(0.0f, points.snr[0]);
+    EXPECT_EQ(0.0f, points.noise[0]);
+}
+
+/*Appends one point in ROS coordinates to points*/
+static void addPoint(mmwDetectedPoints &points, float x, float y, float z, float range, float doppler, float intensity)
+{
+    points.x.push_back(x);
+    points.y.push_back(y);
+    points.z.push_back(z);
+    points.range.push_back(range);
+    points.doppler.push_back(doppler);
+    points.intensity.push_back(intensity);
+    points.snr.push_back(0);
+    points.noise.push_back(0);
+}
+
+TEST(Decode, FieldOfViewFilter)
+{
+    mmwDetectedPoints points;
+    mmwPointFilter filter = acceptAllFilter();
+    std::vector<uint32_t> selected;
+    std::vector<uint32_t> expected;
+    
+    /*45 degree azimuth and 20 degree elevation, range 1 to 5 m, doppler -1 to 1 m/s, intensity 10 to 30 dB*/
+    filter.azimuthRatio = tanf(45 * M_PI / 180);
+    filter.elevationRatioSquared = tanf(20 * M_PI / 180) * tanf(20 * M_PI / 180);
+    filter.minRange = 1;
+    filter.maxRange = 5;
+    filter.minDoppler = -1;
+    filter.maxDoppler = 1;
+    filter.minIntensity = 10;
+    filter.maxIntensity = 30;
+    
+    addPoint(points, 2, 0, 0, 2, 0, 20);           // 0 kept
+    addPoint(points, 0, 0, 0, 2, 0, 20);           // x == 0 dropped (angle undefined)
+    addPoint(points, 0, 1, 0, 2, 0, 20);           // x == 0 dropped
+    addPoint(points, 2, 1.9f, 0, 2, 0, 20);        // 3 kept, azimuth just inside
+    addPoint(points, 2, -2.1f, 0, 2, 0, 20);       // azimuth outside
+    addPoint(points, 2, 0, 0.5f, 2, 0, 20);        // 5 kept, elevation 14 degrees
+    addPoint(points, 2, 0, -1, 2, 0, 20);          // elevation 27 degrees
+    addPoint(points, -2, 0, 0, 2, 0, 20);          // 7 kept, |y| < ratio * |x| behind the sensor too
+    addPoint(points, 2, 0, 0, 1, -1, 10);          // 8 kept, gates are inclusive
+    addPoint(points, 2, 0, 0, 5, 1, 30);           // 9 kept
+    addPoint(points, 2, 0, 0, 0.99f, 0, 20);       // range gate
+    addPoint(points, 2, 0, 0, 2, 1.01f, 20);       // doppler gate
+    addPoint(points, 2, 0, 0, 2, 0, 30.5f);        // intensity gate
+    addPoint(points, 2, 0, 0, 2, 0, 20);           // 13 kept, in the scalar tail
+    
+    expected.push_back(0);
+    expected.push_back(3);
+    expected.push_back(5);
+    expected.push_back(7);
+    expected.push_back(8);
+    expected.push_back(9);
+    expected.push_back(13);
+    
+    EXPECT_EQ(expected.size(), selectDetectedPoints(points, filter, selected));
+    EXPECT_EQ(expected, selected);
+    
+    /*Every gate disabled still drops x == 0*/
+    EXPECT_EQ(points.x.size() - 2, selectDetectedPoints(points, acceptAllFilter(), selected));
+}
+
+TEST(Decode, LogMagProfile)
+{
+    std::vector<uint16_t> profile;
+    std::vector<float> db;
+    
+    /*Odd length, more than a vector register holds, so the vector loop and the scalar tail both run*/
+    for(uint16_t v = 0; v < 19; v++)
+    {
+        profile.push_back(v * 512);
+    }
+    profile.push_back(0xFFFF);
+    db.resize(profile.size());
+    
+    decodeLogMagProfile((const uint8_t *) profile.data(), profile.size(), db.data());
+    
+    for(size_t i = 0; i < profile.size(); i++)
+    {
+        EXPECT_NEAR(profile[i] * TEST_LOG_MAG_TO_DB, db[i], 1e-3) << "bin " << i;
+    }
+    EXPECT_EQ(0.0f, db[0]);
+    EXPECT_NEAR(6.0206f, db[1], 1e-3);
+}
+
+TEST(Decode, RangeDopplerHeatmapShift)
+{
+    static const size_t dopplerBinCounts[] = {1, 4, 5, 16, 17};
+    size_t numRangeBins = 3;
+    
+    /*Column (k + N/2) % N of a row holds doppler bin k, like numpy.fft.fftshift for even and odd N*/
+    for(size_t c = 0; c < sizeof(dopplerBinCounts) / sizeof(dopplerBinCounts[0]); c++)
+    {
+        size_t numDopplerBins = dopplerBinCounts[c];
+        std::vector<uint16_t> heatmap(numRangeBins * numDopplerBins);
+        std::vector<float> db(heatmap.size(), -1.0f);
+        
+        for(size_t r = 0; r < numRangeBins; r++)
+        {
+            for(size_t k = 0; k < numDopplerBins; k++)
+            {
+                heatmap[r * numDopplerBins + k] = (r * 100 + k) * 8;
+            }
+        }
+        
+        decodeRangeDopplerHeatmap((const uint8_t *) heatmap.data(), numRangeBins, numDopplerBins, db.data());
+        
+        for(size_t r = 0; r < numRangeBins; r++)
+        {
+            for(size_t k = 0; k < numDopplerBins; k++)
+            {
+                EXPECT_NEAR((r * 100 + k) * 8 * TEST_LOG_MAG_TO_DB, db[r * numDopplerBins + (k + numDopplerBins / 2) % numDopplerBins], 1e-3)
+                    << numDopplerBins << " doppler bins, range bin " << r << " doppler bin " << k;
+            }
+        }
+    }
+}
+
+TEST(Decode, NormalizeToMono8)
+{
+    std::vector<float> image;
+    std::vector<uint8_t> mono;
+    
+    /*Minimum to 0, maximum to 255, linear in between*/
+    for(int i = 0; i < 11; i++)
+    {
+        image.push_back(-20.0f + i * 5.1f);
+    }
+    mono.resize(image.size());
+    normalizeToMono8(image.data(), image.size(), mono.data());
+    EXPECT_EQ(0, mono[0]);
+    EXPECT_EQ(255, mono[10]);
+    EXPECT_EQ(128, mono[5]);
+    for(size_t i = 1; i < mono.size(); i++)
+    {
+        EXPECT_GT(mono[i], mono[i - 1]);
+    }
+    
+    /*A constant image (no range of values to scale) maps to 0 instead of dividing by zero*/
+    image.assign(7, 42.0f);
+    mono.assign(image.size(), 0xAA);
+    normalizeToMono8(image.data(), image.size(), mono.data());
+    for(size_t i = 0; i < mono.size(); i++)
+    {
+        EXPECT_EQ(0, mono[i]);
+    }
+    
+    /*Nothing to do for an empty image*/
+    normalizeToMono8(image.data(), 0, mono.data());
+}
+
+/*Stand-in for RadarPoint, which needs PCL*/
+struct TestPoint
+{
+    float x;
+    float y;
+    float z;
+    float intensity;
+    float range;
+    float doppler;
+    float snr;
+    float noise;
+};
+
+/*What the read and sort threads keep between packets*/
+struct DataPathState
+{
+    mmwUnitTables tables;
+    
+    mmwPointFilter filter;
+    
+    mmwDataPacket data;
+    
+    mmwDetectedPoints points;
+    
+    std::vector<uint32_t> selected;
+    
+    std::vector<TestPoint> cloud;
+};
+
+/*Frames stream and decodes the points of every packet like the read and sort threads, returns the number of packets*/
+static size_t runDataPath(DataPathState &state, const std::vector<uint8_t> &stream)
+{
+    mmwFramer framer(TEST_MAX_PACKET_LEN * 4);
+    size_t pos = 0;
+    size_t numPackets = 0;
+    size_t n;
+    uint32_t offset, tlvType;
+    FrameView tlv;
+    
+    while(pos < stream.size())
+    {
+        if(framer.next(&stream[pos], stream.size() - pos, n, true) != MMW_FRAMER_PACKET)
+        {
+            break;
+        }
+        
+        FrameView frame(&stream[pos], n);
+        uint32_t version = frame.get<uint32_t>(sizeof(magicWord));
+        uint32_t platform = frame.get<uint32_t>(sizeof(magicWord) + 8);
+        
+        offset = sizeof(magicWord) + packetHeaderSize(version, platform);
+        while(nextTlv(frame, offset, tlvType, tlv))
+        {
+            if(packetLayout(version, platform) == MMW_LAYOUT_SDK2)
+            {
+                EXPECT_TRUE(decodePointCloudTlv(tlv, FrameView(), frame.get<uint32_t>(sizeof(magicWord) + 20), state.filter, state.cloud));
+            }
+            else
+            {
+                EXPECT_TRUE(decodeDetectedObjsTlv(tlv, FrameView(), state.tables, state.filter, state.data, state.points, state.selected));
+            }
+        }
+        
+        numPackets++;
+        pos += n;
+    }
+    
+    return numPackets;
+}
+
+TEST(DataPath, NoAllocationsAfterWarmUp)
+{
+    DataPathState state;
+    std::vector<uint8_t> stream;
+    size_t numPackets;
+    
+    buildTestUnitTables(state.tables);
+    state.filter = acceptAllFilter();
+    
+    /*SDK 1.x and 3.x packets with changing point counts, the largest ones first*/
+    for(uint32_t i = 1; i <= 50; i++)
+    {
+        std::vector<uint8_t> packet = makePacket(i, (i == 1) ? 60 : i % 40);
+        std::vector<uint8_t> sdk3Packet = makeSdk3Packet(0x000A6843, i, (i == 1) ? 60 : i % 40);
+        
+        stream.insert(stream.end(), packet.begin(), packet.end());
+        stream.insert(stream.end(), sdk3Packet.begin(), sdk3Packet.end());
+    }
+    
+    /*The first pass sizes the buffers, the same packets again must not allocate*/
+    ASSERT_EQ(100u, runDataPath(state, stream));
+    
+    numAllocations = 0;
+    countAllocations = true;
+    numPackets = runDataPath(state, stream);
+    countAllocations = false;
+    
+    EXPECT_EQ(100u, numPackets);
+    EXPECT_EQ(0u, numAllocations);
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    
+    return RUN_ALL_TESTS();
+}